@@ -5,12 +5,15 @@ using namespace std;
 
 #include "ADCInternal.h"
 #include "Blinker.h"
+#include "GpsFixHistory.h"
 #include "JSONMsgRouter.h"
 #include "SubsystemCopilotControl.h"
 #include "SubsystemGps.h"
 #include "SubsystemTx.h"
 #include "Time.h"
 #include "TempSensorInternal.h"
+#include "TxWarmupModel.h"
+#include "WsprMessageChain.h"
 #include "USB.h"
 
 
@@ -113,6 +116,9 @@ public:
         SetupShell();
         SetupJSON();
 
+        // Give JavaScript access to satellite statistics
+        CopilotControlJavaScript::SetGpsSatStats(&ssGps_.GetSatStats());
+
         if (testCfg.enabled && testCfg.logAsync == false)
         {
             Evm::DisableAutoLogAsync();
@@ -123,6 +129,9 @@ public:
         ssTx_.SetCallbackOnTxStart([this]{
             Watchdog::Feed();
             blinker_.On();
+
+            // warmup, if any, is over
+            EndTxWarmupObservation();
         });
         ssTx_.SetCallbackOnBitChange([this]{
             Watchdog::Feed();
@@ -243,6 +252,45 @@ public:
     }
 
 
+    // Measures the MCU timebase error against the GPS PPS, for
+    // diagnostics. Reports to the web page when done.
+    //
+    // This is the RP2040 crystal, not the clockgen's reference, so it says
+    // nothing about the transmit frequency, and no correction is made
+    // from it.
+    bool StartPpsTimebaseCheck(uint32_t durationSec, string &err)
+    {
+        bool retVal = true;
+
+        if (ssGps_.PpsTimebaseCheckInProgress())
+        {
+            retVal = false;
+            err = "PPS timebase check already in progress";
+        }
+        else if (durationSec < PpsTimebaseCheck::SPAN_SEC_MIN || durationSec > PPS_CHECK_DURATION_SEC_MAX)
+        {
+            retVal = false;
+            err = "Duration must be " + to_string(PpsTimebaseCheck::SPAN_SEC_MIN) + " to " + to_string(PPS_CHECK_DURATION_SEC_MAX) + " sec";
+        }
+        else
+        {
+            ssGps_.StartPpsTimebaseCheck(durationSec, [this](const PpsTimebaseCheck::Result &result){
+                router_.Send([&](const auto &out){
+                    out["type"]        = "PPS_TIMEBASE_CHECK";
+                    out["ok"]          = result.ok;
+                    out["err"]         = result.ok ? "" : "Not enough PPS samples, is there a GPS lock?";
+                    out["mcuErrPpm"]   = result.errPpb / 1'000.0;
+                    out["residualUs"]  = result.residualUs;
+                    out["sampleCount"] = result.sampleCount;
+                    out["spanSec"]     = result.spanSec;
+                });
+            });
+        }
+
+        return retVal;
+    }
+
+
     /////////////////////////////////////////////////////////////////
     // Flight Mode
     /////////////////////////////////////////////////////////////////
@@ -279,15 +327,17 @@ public:
         }
         else
         {
+            ssTx_.LockFlightConfiguration();
             ssTx_.SetupTransmitterForFlight();
 
             Configuration &txCfg = ssTx_.GetConfiguration();
-            auto cd = WsprChannelMap::GetChannelDetails(txCfg.band.c_str(), txCfg.channel);
+            auto cd = ssTx_.GetChannelDetails();
+            auto bc = ssTx_.GetBandAndChannel();
 
             Log("==== Ok to fly! ====");
             Log("Callsign  : ", txCfg.callsign);
-            Log("Band      : ", txCfg.band);
-            Log("Channel   : ", txCfg.channel);
+            Log("Band      : ", bc.band);
+            Log("Channel   : ", bc.channel);
             Log("ID13      : ", cd.id13);
             Log("Min       : ", cd.min);
             Log("Lane      : ", cd.lane);
@@ -343,9 +393,22 @@ public:
             scheduler.OnGps3DPlusLock(fix3dPlus_);
         }, { .argCount = 0, .help = "trigger 3d lock"});
 
+        Shell::AddCommand("app.fix.history", [this](vector<string> argList){
+            fixHistory_.Print(PAL.Micros());
+        }, { .argCount = 0, .help = "show fix history and coast estimate"});
+
         scheduler.SetCallbackRequestNewGpsLock([this, &scheduler]{
             BlinkerGpsSearch();
 
+            // The lock requested here schedules the next window, which
+            // moves on to the next entry of the TX plan, if any.
+            // The first request is for the first window.
+            if (gpsRequestedBefore_ && ssTx_.AdvanceTxPlan())
+            {
+                scheduler.SetStartMinute(ssTx_.GetChannelDetails().min);
+            }
+            gpsRequestedBefore_ = true;
+
             t_.Reset();
             t_.SetMaxEvents(50);
             t_.Event("GPS_REQUESTED");
@@ -383,6 +446,9 @@ public:
                 // note that the 3d fix was acquired
                 gotFix3dPlus_ = true;
 
+                // keep for estimating position when coasting
+                fixHistory_.Add(fix3dPlus_);
+
                 // tell scheduler
                 scheduler.OnGps3DPlusLock(fix3dPlus_);
             };
@@ -412,18 +478,61 @@ public:
     {
         auto &scheduler = ssCc_.GetScheduler();
 
+        DefineVendorDefinedSatStats();
+        LoadSatStatsSlot();
+
+        Shell::AddCommand("app.sat.slot", [this](vector<string> argList){
+            if (argList.size() >= 1)
+            {
+                uint8_t slot = argList[0] == "off" ? 0 : (uint8_t)atoi(argList[0].c_str());
+
+                string err;
+                if (SetSatStatsSlot(slot, err) == false)
+                {
+                    Log("ERR: ", err);
+                }
+            }
+
+            Log("Sat stats chain: ", satStatsSlot_ ? "slot " + to_string(satStatsSlot_) + " on" : string{"off"});
+        }, { .argCount = -1, .help = "send sat stats when coasting without lock from [<slot>|off]"});
+
         scheduler.SetCallbackScheduleNow([this, &scheduler](bool haveGpsLock){
-            scheduler.UnSetCallbackSendDefault(1);
-            scheduler.UnSetCallbackSendDefault(2);
-            
+            for (uint8_t slot = 1; slot <= 5; ++slot)
+            {
+                scheduler.UnSetCallbackSendDefault(slot);
+            }
+
+            GpsFixHistory::Estimate est;
+
             if (haveGpsLock)
             {
                 scheduler.SetCallbackSendDefault(1, true, [this](uint8_t, uint64_t){ SendRegularType1();   });
                 scheduler.SetCallbackSendDefault(2, true, [this](uint8_t, uint64_t){ SendBasicTelemetry(); });
             }
+            else if (coastCount_ % 2 == 0 && fixHistory_.GetEstimate(PAL.Micros(), est))
+            {
+                // coasting, but a recent fix lets position be estimated.
+                // basic telemetry goes out flagged as not gps-valid.
+                //
+                // only every other coasted window, starting with the
+                // second, so the gps diagnostics below still go out in
+                // the first window without lock, and alternate after.
+                scheduler.SetCallbackSendDefault(1, false, [this](uint8_t, uint64_t){ SendRegularType1Estimated();   });
+                scheduler.SetCallbackSendDefault(2, false, [this](uint8_t, uint64_t){ SendBasicTelemetryEstimated(); });
+            }
             else
             {
                 scheduler.SetCallbackSendDefault(1, false, [this](uint8_t, uint64_t){ SendVendorDefinedGpsData(); });
+
+                // satellite detail to diagnose the lack of lock follows, in
+                // the slots opted in to it only
+                if (satStatsSlot_)
+                {
+                    for (uint8_t seq = 0; seq < msgSatChain_.GetMsgCount(); ++seq)
+                    {
+                        scheduler.SetCallbackSendDefault(satStatsSlot_ + seq, false, [this, seq](uint8_t slot, uint64_t){ SendVendorDefinedSatStats(slot, seq); });
+                    }
+                }
             }
         });
 
@@ -445,13 +554,52 @@ public:
             ssTx_.RadioOn();
             ssTx_.SetupTransmitterForFlight();
 
+            StartTxWarmupObservation();
+
             BlinkerTransmit();
         });
 
         scheduler.SetCallbackStopRadio([this]{
+            timerTxWarmupSample_.Cancel();
+            txWarmupModel_.OnWarmupAbandon();
+
             ssTx_.RadioOff();
             ssTx_.Disable();
+
+            // radio is off, safe to write what was learned
+            txWarmupModel_.Flush();
+        });
+
+        scheduler.SetCallbackGetWarmupDurationUs([this]{
+            return txWarmupModel_.GetWarmupDurationUs(tempSensor_.GetTempC());
         });
+
+        txWarmupModel_.Load();
+
+        Shell::AddCommand("app.tx.warmup", [this](vector<string> argList){
+            if      (argList[0] == "on")    { txWarmupModel_.SetEnabled(true);  }
+            else if (argList[0] == "off")   { txWarmupModel_.SetEnabled(false); }
+            else if (argList[0] == "clear") { txWarmupModel_.Clear();           }
+
+            txWarmupModel_.Print(tempSensor_.GetTempC());
+        }, { .argCount = 1, .help = "TX learned warmup <show/on/off/clear>, kept in flash"});
+    }
+
+    void StartTxWarmupObservation()
+    {
+        txWarmupModel_.OnWarmupStart(PAL.Micros(), tempSensor_.GetTempC());
+
+        timerTxWarmupSample_.SetName("TIMER_TX_WARMUP_SAMPLE");
+        timerTxWarmupSample_.SetCallback([this]{
+            txWarmupModel_.OnSample(PAL.Micros(), tempSensor_.GetTempC());
+        });
+        timerTxWarmupSample_.TimeoutIntervalMs(1'000);
+    }
+
+    void EndTxWarmupObservation()
+    {
+        timerTxWarmupSample_.Cancel();
+        txWarmupModel_.OnWarmupEnd(PAL.Micros());
     }
 
     void SetupSchedulerClockSpeed()
@@ -492,8 +640,7 @@ public:
     {
         auto &scheduler = ssCc_.GetScheduler();
 
-        Configuration &txCfg = ssTx_.GetConfiguration();
-        auto cd = WsprChannelMap::GetChannelDetails(txCfg.band.c_str(), txCfg.channel);
+        auto cd = ssTx_.GetChannelDetails();
         scheduler.SetStartMinute(cd.min);
     }
 
@@ -503,26 +650,36 @@ public:
     /////////////////////////////////////////////////////////////////
 
     void SendRegularType1()
+    {
+        SendRegularType1(fix3dPlus_.maidenheadGrid);
+    }
+
+    void SendRegularType1(const string &grid)
     {
         const Configuration &txCfg = ssTx_.GetConfiguration();
         static const uint8_t POWER_DBM = 13;
 
         Log("Sending regular start");
-        ssTx_.SendRegularMessage(txCfg.callsign, fix3dPlus_.maidenheadGrid.substr(0, 4), POWER_DBM);
+        ssTx_.SendRegularMessage(txCfg.callsign, grid.substr(0, 4), POWER_DBM);
         Log("Sending regular done");
     };
 
     void SendBasicTelemetry()
+    {
+        bool gpsValid = true;
+
+        SendBasicTelemetry(fix3dPlus_.maidenheadGrid, fix3dPlus_.altitudeM, fix3dPlus_.speedKnots, gpsValid);
+    }
+
+    void SendBasicTelemetry(const string &grid, int32_t altitudeM, uint32_t speedKnots, bool gpsValid)
     {
         // get data needed to fill out encoded message
-        const Configuration &txCfg = ssTx_.GetConfiguration();
-        WsprChannelMap::ChannelDetails cd = WsprChannelMap::GetChannelDetails(txCfg.band.c_str(), txCfg.channel);
+        WsprChannelMap::ChannelDetails cd = ssTx_.GetChannelDetails();
 
-        string   grid56    = fix3dPlus_.maidenheadGrid.substr(4, 2);
-        uint32_t altM      = fix3dPlus_.altitudeM < 0 ? 0 : fix3dPlus_.altitudeM;
+        string   grid56    = grid.substr(4, 2);
+        uint32_t altM      = altitudeM < 0 ? 0 : altitudeM;
         int8_t   tempC     = tempSensor_.GetTempC();
         double   voltage   = (double)ADC::GetMilliVoltsVCC() / 1'000;  // capture under max load
-        bool     gpsValid  = true;
 
         ssTx_.SendTelemetryBasic(
             cd.id13,
@@ -530,15 +687,47 @@ public:
             altM,
             tempC,
             voltage,
-            fix3dPlus_.speedKnots,
+            speedKnots,
             gpsValid
         );
     };
 
+    // Position is estimated at the time of sending, and if it has become
+    // too old to estimate since being scheduled, the last fix is used.
+    void SendRegularType1Estimated()
+    {
+        GpsFixHistory::Estimate est = GetPositionEstimate();
+
+        Log("Sending estimated position ", est.grid, " (", est.ageSec, " sec since fix)");
+
+        SendRegularType1(est.grid);
+    }
+
+    void SendBasicTelemetryEstimated()
+    {
+        GpsFixHistory::Estimate est = GetPositionEstimate();
+        bool gpsValid = false;
+
+        SendBasicTelemetry(est.grid, est.altM, est.speedKnots, gpsValid);
+    }
+
+    GpsFixHistory::Estimate GetPositionEstimate()
+    {
+        GpsFixHistory::Estimate retVal;
+
+        if (fixHistory_.GetEstimate(PAL.Micros(), retVal) == false)
+        {
+            retVal.grid       = fix3dPlus_.maidenheadGrid;
+            retVal.altM       = fix3dPlus_.altitudeM;
+            retVal.speedKnots = fix3dPlus_.speedKnots;
+        }
+
+        return retVal;
+    }
+
     void SendUserDefined(uint8_t slot, MsgUD &msg, uint64_t quitAfterMs)
     {
-        const Configuration &txCfg = ssTx_.GetConfiguration();
-        WsprChannelMap::ChannelDetails cd = WsprChannelMap::GetChannelDetails(txCfg.band.c_str(), txCfg.channel);
+        WsprChannelMap::ChannelDetails cd = ssTx_.GetChannelDetails();
 
         msg.SetId13(cd.id13);
         msg.SetHdrSlot(slot - 1);
@@ -595,8 +784,7 @@ public:
         msgVd_.Set(fieldSatsBD,            satsBD);
 
         // configure and encode
-        const Configuration &txCfg = ssTx_.GetConfiguration();
-        WsprChannelMap::ChannelDetails cd = WsprChannelMap::GetChannelDetails(txCfg.band.c_str(), txCfg.channel);
+        WsprChannelMap::ChannelDetails cd = ssTx_.GetChannelDetails();
 
         msgVd_.SetId13(cd.id13);
         msgVd_.SetHdrSlot(0);
@@ -615,6 +803,138 @@ public:
     }
 
 
+    // Per-constellation satellite statistics, more than fits in one
+    // message, so sent as a chain over sequential slots.
+    void DefineVendorDefinedSatStats()
+    {
+        msgSatChain_.ResetEverything();
+
+        for (const char *talker : { "GP", "BD" })
+        {
+            string t = talker;
+
+            bool ok = true;
+            ok &= msgSatChain_.DefineField(("SatsInView"  + t + "Count").c_str(), 0, 40, 1);
+            ok &= msgSatChain_.DefineField(("SatsTracked" + t + "Count").c_str(), 0, 40, 1);
+            ok &= msgSatChain_.DefineField(("Cn0Mean"     + t + "DbHz").c_str(),  0, 60, 2);
+            ok &= msgSatChain_.DefineField(("Cn0Max"      + t + "DbHz").c_str(),  0, 60, 2);
+
+            if (ok == false)
+            {
+                Log("ERR: Sat stats chain: ", msgSatChain_.GetDefineFieldErr());
+            }
+        }
+    }
+
+    // The chain is only sent if opted in to, by giving the slot it starts
+    // at. Slots default to sending nothing when their user definition
+    // can't be used, and a chain is not something a decoder knows about
+    // unless told.
+    //
+    // Stored as text, eg "v1 slot=3".
+    void LoadSatStatsSlot()
+    {
+        satStatsSlot_ = 0;
+
+        vector<string> partList = Split(FilesystemLittleFS::Read(SAT_STATS_FILE_NAME), " ");
+
+        if (partList.size() == 2 && partList[0] == "v1" && partList[1].starts_with("slot="))
+        {
+            uint8_t slot = (uint8_t)atoi(partList[1].c_str() + 5);
+
+            string err;
+            if (SatStatsSlotOk(slot, err))
+            {
+                satStatsSlot_ = slot;
+            }
+        }
+    }
+
+    bool SetSatStatsSlot(uint8_t slot, string &err)
+    {
+        bool retVal = false;
+
+        if (slot == 0)
+        {
+            satStatsSlot_ = 0;
+            FilesystemLittleFS::Remove(SAT_STATS_FILE_NAME);
+
+            retVal = true;
+        }
+        else if (SatStatsSlotOk(slot, err))
+        {
+            retVal = FilesystemLittleFS::Write(SAT_STATS_FILE_NAME, "v1 slot=" + to_string(slot));
+
+            if (retVal)
+            {
+                satStatsSlot_ = slot;
+            }
+            else
+            {
+                err = "Could not store to flash";
+            }
+        }
+
+        return retVal;
+    }
+
+    // slot 1 carries the gps data, and the chain must fit in the window
+    bool SatStatsSlotOk(uint8_t slot, string &err)
+    {
+        uint8_t msgCount = msgSatChain_.GetMsgCount();
+
+        if (msgCount == 0)
+        {
+            err = "No sat stats messages defined";
+
+            return false;
+        }
+
+        uint8_t slotMax = 5 - (msgCount - 1);
+
+        bool retVal = slot >= 2 && slot <= slotMax;
+
+        if (retVal == false)
+        {
+            err = "Slot must be 2 to " + to_string(slotMax);
+        }
+
+        return retVal;
+    }
+
+    // The record is captured when its first message is sent, so that all
+    // messages describe the same moment.
+    void SendVendorDefinedSatStats(uint8_t slot, uint8_t seq)
+    {
+        if (seq == 0)
+        {
+            const GpsSatStats &satStats = ssGps_.GetSatStats();
+
+            for (auto con : { GpsSatStats::Constellation::GPS, GpsSatStats::Constellation::BEIDOU })
+            {
+                string t = GpsSatStats::GetTalker(con);
+                const GpsSatStats::Stats &stats = satStats.Get(con);
+
+                msgSatChain_.Set(("SatsInView"  + t + "Count").c_str(), min<uint8_t>(stats.inView,  40));
+                msgSatChain_.Set(("SatsTracked" + t + "Count").c_str(), min<uint8_t>(stats.tracked, 40));
+                msgSatChain_.Set(("Cn0Mean"     + t + "DbHz").c_str(),  min<uint8_t>(stats.cn0Mean, 60));
+                msgSatChain_.Set(("Cn0Max"      + t + "DbHz").c_str(),  min<uint8_t>(stats.cn0Max,  60));
+            }
+        }
+
+        MsgVD &msg = msgSatChain_.GetMsg(seq);
+
+        msg.SetId13(ssTx_.GetChannelDetails().id13);
+        msg.SetHdrSlot(slot - 1);
+        msg.Encode();
+
+        Log("Sending VendorDefined sat stats ", seq + 1, " of ", msgSatChain_.GetMsgCount(), " in slot ", slot);
+
+        ssTx_.SendMessage(msg);
+        Log("Sent");
+    }
+
+
     /////////////////////////////////////////////////////////////////
     // GPS health
     /////////////////////////////////////////////////////////////////
@@ -630,6 +950,9 @@ public:
             LogNL();
             Log("No GPS Lock within ", Time::MakeTimeMMSSmmmFromUs(TWENTY_MINUTES));
 
+            // keep what we know about time for the next boot
+            ssGps_.SaveWarmStartBeforeReboot();
+
             // hard reset GPS
             Log("Hard Resetting GPS");
             ssGps_.ModuleHardReset();
@@ -655,6 +978,8 @@ public:
         // - Any attempt at a lock can take no more than the max timeout
         //   - This applies to getting either a time lock or 3d lock
         // - The system can coast for no more than 2 consecutive windows
+        //   - or 3 once the clock drift rate is known and corrected for, since
+        //     coasted windows then stay on time
         //
         // The consequences are:
         // - In a default configuration, where 3d fix required, and only coasting
@@ -675,7 +1000,8 @@ public:
         gotFix3dPlus_ = false;
 
         // consider if coasting too much
-        const uint8_t COAST_COUNT_MAX = 2;
+        const uint8_t COAST_COUNT_MAX =
+            ssCc_.GetScheduler().GetTimeDiscipline().IsTrusted() ? 3 : 2;
         if (coastCount_ > COAST_COUNT_MAX)
         {
             LogModeSync();
@@ -683,6 +1009,9 @@ public:
             LogNL();
             Log("Coast attempt exceeds limit (", coastCount_, " would exceed max of ", COAST_COUNT_MAX, " consecutive)");
 
+            // keep what we know about time for the next boot
+            ssGps_.SaveWarmStartBeforeReboot();
+
             // hard reset GPS
             Log("Hard Resetting GPS");
             ssGps_.ModuleHardReset();
@@ -845,6 +1174,16 @@ private:
             ++count;
         });
 
+        Shell::AddCommand("app.gps.pps", [this](vector<string> argList){
+            uint32_t durationSec = argList.size() >= 1 ? (uint32_t)atoi(argList[0].c_str()) : 20;
+
+            string err;
+            if (StartPpsTimebaseCheck(durationSec, err) == false)
+            {
+                Log("ERR: ", err);
+            }
+        }, { .argCount = -1, .help = "measure mcu clock error against gps pps [sec]"});
+
         Shell::AddCommand("app.count", [this](vector<string> argList){
             Log(count);
         }, { .argCount = 0, .help = ""});
@@ -865,6 +1204,19 @@ private:
             Log(jsonStr);
         });
 
+        // result arrives later as PPS_TIMEBASE_CHECK
+        JSONMsgRouter::RegisterHandler("REQ_PPS_TIMEBASE_CHECK", [this](auto &in, auto &out){
+            out["type"] = "REP_PPS_TIMEBASE_CHECK";
+
+            uint32_t durationSec = (uint32_t)in["durationSec"];
+
+            Log("REQ_PPS_TIMEBASE_CHECK: ", durationSec, " sec");
+
+            string err;
+            out["ok"]  = StartPpsTimebaseCheck(durationSec, err);
+            out["err"] = err;
+        });
+
         JSONMsgRouter::RegisterHandler("REQ_GET_DEVICE_INFO", [this](auto &in, auto &out){
             out["type"] = "REP_GET_DEVICE_INFO";
 
@@ -893,17 +1245,28 @@ private:
     Fix3DPlus fix3dPlus_;
     bool gotFix3dPlus_ = false;
     uint8_t coastCount_ = 0;
+    GpsFixHistory fixHistory_;
+    bool gpsRequestedBefore_ = false;
 
     JSONMsgRouter::Iface router_;
 
+    static const uint32_t PPS_CHECK_DURATION_SEC_MAX = 300;
+
     Timer timerStartupRole_;
     Timer timerWatchdog_;
     Timer timerGpsLockOrDie_;
 
     Blinker blinker_;
 
+    TxWarmupModel txWarmupModel_;
+    Timer timerTxWarmupSample_;
+
     using MsgVD = WsprMessageTelemetryExtendedVendorDefined<29>;
     static inline MsgVD msgVd_;
+    static inline WsprMessageChain<MsgVD, 3> msgSatChain_;
+
+    inline static const char *SAT_STATS_FILE_NAME = "satstats.txt";
+    uint8_t satStatsSlot_ = 0;
 
     Timeline t_;
 
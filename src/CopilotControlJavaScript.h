@@ -3,7 +3,17 @@
 #include "CopilotControlConfiguration.h"
 #include "CopilotControlMessageDefinition.h"
 #include "CopilotControlUtl.h"
+#include "GpsSatStats.h"
 #include "JerryScriptIntegration.h"
+#include "JSBindingHooks.h"
+#include "JSCpuProfile.h"
+#include "JSHeapProfile.h"
+#include "JSInputRecorder.h"
+#include "JSKvStore.h"
+#include "JSMath.h"
+#include "JSScriptCheck.h"
+#include "JSScriptScan.h"
+#include "JSSensorCache.h"
 #include "JSFn_DelayMs.h"
 #include "JSObj_ADC.h"
 #include "JSObj_BH1750.h"
@@ -22,17 +32,35 @@
 #include "Utl.h"
 #include "WsprEncodedDynamic.h"
 
+#include <algorithm>
 #include <string>
 #include <vector>
 using namespace std;
 
 
+// Extra work to do around a script run
+struct JavaScriptRunOptions
+{
+    bool heapProfile    = false;
+    bool cpuProfile     = false;
+    bool sensorPrefetch = false;    // see JSSensorCache
+    bool validate       = false;    // dry run, see JSScriptCheck
+    bool custom         = false;    // not the slot's stored script, see RunJavaScript
+
+    const JSInputRecorder::Recording *replay = nullptr;     // inputs to run with, see JSInputRecorder
+};
+
+
 class CopilotControlJavaScript
 {
 public:
 
     CopilotControlJavaScript()
     {
+        sensorCache_.Load();
+        kvStore_.Load();
+        inputRecorder_.Load();
+
         SetupShell();
         SetupJSON();
         CalculateJavaScriptBaselineUsage();
@@ -44,6 +72,11 @@ public:
         return SCRIPT_TIME_LIMIT_MS;
     }
 
+    static void SetGpsSatStats(const GpsSatStats *satStats)
+    {
+        satStats_ = satStats;
+    }
+
 
 private:
 
@@ -73,6 +106,43 @@ private:
             JSProxy_GPS::Proxy(obj, gpsFixUse);
         });
 
+        // GPS Satellite Statistics API
+        // kept off the gps object, as these don't depend on having a fix
+        JerryScript::UseThenFreeNewObj([&](auto obj){
+            JerryScript::SetGlobalPropertyNoFree("sat", obj);
+
+            for (auto con : { GpsSatStats::Constellation::GPS, GpsSatStats::Constellation::BEIDOU })
+            {
+                string suffix = GpsSatStats::GetTalker(con);
+
+                auto GetStats = [con]{
+                    static const GpsSatStats::Stats STATS_NONE;
+                    return satStats_ ? satStats_->Get(con) : STATS_NONE;
+                };
+
+                JerryScript::SetPropertyToNativeFunction(obj, ("GetInView" + suffix).c_str(), [=]{
+                    return GetStats().inView;
+                });
+                JerryScript::SetPropertyToNativeFunction(obj, ("GetTracked" + suffix).c_str(), [=]{
+                    return GetStats().tracked;
+                });
+                JerryScript::SetPropertyToNativeFunction(obj, ("GetCn0Mean" + suffix).c_str(), [=]{
+                    return GetStats().cn0Mean;
+                });
+                JerryScript::SetPropertyToNativeFunction(obj, ("GetCn0Max" + suffix).c_str(), [=]{
+                    return GetStats().cn0Max;
+                });
+                for (uint8_t bin = 0; bin < GpsSatStats::ELEV_BIN_COUNT; ++bin)
+                {
+                    string name = string{"GetInViewElev"} + GpsSatStats::GetElevBinName(bin) + suffix;
+
+                    JerryScript::SetPropertyToNativeFunction(obj, name.c_str(), [=]{
+                        return GetStats().elevBinList[bin];
+                    });
+                }
+            }
+        });
+
         // I2C API
         JSObj_I2C::SetI2CInstance(I2C::Instance::I2C1);
         JSObj_I2C::Register();
@@ -103,6 +173,9 @@ private:
         // Basic Functions API
         JSFn_DelayMs::Register();
 
+        // Math API
+        JSMath::Register();
+
         // BH1750 Sensor API
         JSObj_BH1750::SetI2CInstance(I2C::Instance::I2C1);
         JSObj_BH1750::Register();
@@ -143,30 +216,96 @@ private:
         string   runOutput;
 
         string  msgStateStr;
+
+        // filled in by a validation run
+        vector<string> fieldSetList;
+        vector<string> unknownApiList;
+
+        // filled in by a replay run, calls the recording had no answer for
+        uint16_t replayMissCount = 0;
+
+        JSHeapProfile heapProfile;
+        JSCpuProfile  cpuProfile;
     };
 
-    JavaScriptRunResult RunSlotJavaScriptCustomScript(const string &slotName, const string &script)
+    JavaScriptRunResult RunSlotJavaScriptCustomScript(const string &slotName, const string &script, JavaScriptRunOptions opts = {})
     {
         // look up slot context
         MsgUD &msg = CopilotControlMessageDefinition::GetMsgResetAndConfigureBySlotName(slotName);
 
-        return RunJavaScript(script, msg);
+        opts.custom = true;
+
+        return RunJavaScript(script, msg, nullptr, opts, slotName);
     }
 
 public:
-    JavaScriptRunResult RunSlotJavaScript(const string &slotName, Fix3DPlus *gpsFix = nullptr)
+    JavaScriptRunResult RunSlotJavaScript(const string &slotName, Fix3DPlus *gpsFix = nullptr, JavaScriptRunOptions opts = {})
     {
         MsgUD  &msg    = CopilotControlMessageDefinition::GetMsgResetAndConfigureBySlotName(slotName);
         string  script = CopilotControlConfiguration::GetJavaScript(slotName);
 
-        return RunJavaScript(script, msg, gpsFix);
+        return RunJavaScript(script, msg, gpsFix, opts, slotName);
+    }
+
+    // Run a slot's script ahead of time to read the sensors it uses, so
+    // that its real run can use the readings instead of waiting on the
+    // sensors.
+    //
+    // Returns false if the script doesn't use sensors, uses raw I2C or Pin
+    // (which a prefetch run would write to a second time), or failed.
+    bool PrefetchSlotSensors(const string &slotName, Fix3DPlus *gpsFix = nullptr)
+    {
+        bool retVal = false;
+
+        string script = CopilotControlConfiguration::GetJavaScript(slotName);
+
+        if (JSSensorCache::ScriptCanPrefetch(script))
+        {
+            Log("Prefetching sensors for ", slotName);
+
+            retVal = RunSlotJavaScript(slotName, gpsFix, { .sensorPrefetch = true }).runOk;
+        }
+
+        return retVal;
+    }
+
+    // Sensor readings are shared by the slot scripts of one window only
+    void ClearSensorCache()
+    {
+        sensorCache_.Clear();
+    }
+
+    // Save the script store to flash, if persisted and changed
+    void FlushStore()
+    {
+        kvStore_.Flush();
+    }
+
+    // Save the window's recorded script inputs to flash, if any
+    void FlushInputRecording()
+    {
+        inputRecorder_.Flush();
     }
 private:
 
-    JavaScriptRunResult RunJavaScript(const string &script, MsgUD &msg, Fix3DPlus *gpsFix = nullptr)
+    // Only slot script runs, named by slotName, use the sensor cache, and
+    // only those which aren't a prefetch keep their writes to the store,
+    // or have their inputs recorded.
+    //
+    // A custom script run for a slot (eg one uploaded to be tried) is
+    // wrapped in the same layers as the slot's flight run would be, so
+    // its time and heap are what flight would see, but keeps nothing: no
+    // store writes, no recording, and no readings put in the sensor cache
+    // (nor taken from it, so sensors are read as on a cold cache).
+    JavaScriptRunResult RunJavaScript(const string &script, MsgUD &msg, Fix3DPlus *gpsFix = nullptr, JavaScriptRunOptions opts = {}, const string &slotName = "")
     {
         JavaScriptRunResult retVal;
 
+        bool useSensorCache = slotName != "" && JSSensorCache::ScriptUsesSensors(script);
+        bool keepStore      = slotName != "" && opts.sensorPrefetch == false && opts.custom == false;
+        bool recordInputs   = keepStore && inputRecorder_.GetEnabled();
+        bool useRecorder    = (slotName != "" && opts.sensorPrefetch == false && inputRecorder_.GetEnabled()) || opts.replay;
+
         Log("Running script");
         JerryScript::UseVM([&]{
             // parse to detect errors
@@ -182,21 +321,84 @@ private:
                 // load javascript integrations
                 LoadJavaScriptBindings(msg, gpsFix);
 
-                // set maximum execution time
+                // hooks on the bindings, the first closest to the script
+                vector<const char *> hookList;
+
+                // record (or replay) what the script sees, so first
+                if (useRecorder)
+                {
+                    inputRecorder_.Start(slotName, script, opts.replay);
+                    hookList.push_back(JSInputRecorder::GetHook());
+                }
+
+                // sensor readings from (or for) a prefetch
+                if (useSensorCache)
+                {
+                    sensorCache_.Register(slotName, opts.sensorPrefetch, opts.custom == false);
+                    hookList.push_back(JSSensorCache::GetHook());
+                }
+
+                // state kept across runs
+                kvStore_.Register();
+
+                // dry run, with the bindings as they are before the script changes them
+                if (opts.validate)
+                {
+                    retVal.unknownApiList = JSScriptCheck::GetUnknownApiList(script);
+                    hookList.push_back(JSScriptCheck::GetHook());
+                }
+
+                if (opts.cpuProfile)
+                {
+                    hookList.push_back(JSCpuProfile::GetHook());
+                }
+
+                string scriptRun = JSBindingHooks::Instrument(script, hookList);
+
+                // set execution limits
                 JSFn_DelayMs::SetTotalDurationLimitMs(SCRIPT_TIME_LIMIT_MS);
                 JSFn_DelayMs::StartTimeNow();
 
                 // run it
-                retVal.runErr = JerryScript::ParseAndRunScript(script, SCRIPT_TIME_LIMIT_MS);
+                if (opts.cpuProfile)
+                {
+                    retVal.cpuProfile.Start(SCRIPT_TIME_LIMIT_MS);
+                    retVal.runErr = JerryScript::ParseAndRunScript(scriptRun, SCRIPT_TIME_LIMIT_MS);
+                    retVal.cpuProfile.Stop();
+                }
+                else
+                {
+                    retVal.runErr = JerryScript::ParseAndRunScript(scriptRun, SCRIPT_TIME_LIMIT_MS);
+                }
+
+                if (opts.validate)
+                {
+                    retVal.fieldSetList = JSScriptCheck::GetFieldSetList(msg.GetFieldList());
+                }
 
                 // capture result of run
                 retVal.runOk      = retVal.runErr == "";
+
+                kvStore_.EndRun(keepStore && retVal.runOk);
+
+                if (useRecorder)
+                {
+                    inputRecorder_.EndRun(recordInputs);
+                    retVal.replayMissCount = inputRecorder_.GetMissCount();
+                }
+
                 retVal.runMs      = JerryScript::GetScriptRunDurationMs();
                 retVal.runDelayMs = JSFn_DelayMs::GetTotalDelayTimeMs();
                 retVal.runOutput  = JerryScript::GetScriptOutput();
 
                 retVal.msgStateStr = CopilotControlUtl::GetMsgStateAsString(msg);
             }
+
+            // look at the heap while the VM is still up
+            if (opts.heapProfile)
+            {
+                retVal.heapProfile.Capture();
+            }
         });
 
         // capture memory utilization stats
@@ -221,6 +423,11 @@ private:
         {
             Log(retVal.runErr);
         }
+        if (opts.cpuProfile)
+        {
+            Log("Script profile:");
+            Log(retVal.cpuProfile.ToString(script));
+        }
         Log("Message state:");
         Log(retVal.msgStateStr);
         LogNL();
@@ -233,27 +440,10 @@ private:
     // JavaScript Utility Functions
     /////////////////////////////////////////////////////////////////
 
+    // not in comments or strings, see JSScriptScan
     bool ScriptHasNonCommentedSubString(const string &script, const string &substr)
     {
-        bool retVal = false;
-
-        vector<string> lineList = Split(script, "\n", false, true);
-
-        string sep = "";
-        for (size_t i = 0; i < lineList.size() && retVal == false; ++i)
-        {
-            string &line = lineList[i];
-
-            // chop off any commented part of the line
-            string lineUncommentedPart = Split(line, "//", false, true)[0];
-
-            // split by the string we're looking for.
-            // if the returned list is greater than 1, the substring exists.
-            vector<string> splitList = Split(lineUncommentedPart, substr, false, true);
-            retVal = splitList.size() > 1;
-        }
-
-        return retVal;
+        return JSScriptScan::GetCode(script).find(substr) != string::npos;
     }
 
     bool ScriptUsesAPIGPS(const string &script)
@@ -271,8 +461,10 @@ public:
 
     struct APIUsage
     {
-        bool gps = false;
-        bool msg = false;
+        bool gps            = false;
+        bool msg            = false;
+        bool sensor         = false;
+        bool sensorPrefetch = false;
     };
 
     APIUsage GetSlotScriptAPIUsage(const string &slotName)
@@ -282,6 +474,8 @@ public:
         return {
             ScriptUsesAPIGPS(script),
             ScriptUsesAPIMsg(script),
+            JSSensorCache::ScriptUsesSensors(script),
+            JSSensorCache::ScriptCanPrefetch(script),
         };
     }
 
@@ -300,9 +494,10 @@ private:
         // their script uses
 
         // create a baseline situation where no fields are configured
-        auto retVal = RunSlotJavaScript("");
+        auto retVal = RunSlotJavaScript("", nullptr, { .heapProfile = true });
 
         runMemUsedBaseline_ = retVal.runMemUsed;
+        heapProfileBaseline_ = retVal.heapProfile;
 
         int pctUse = runMemUsedBaseline_ * 100 / retVal.runMemAvail;
         int pctAvail = 100 - pctUse;
@@ -325,6 +520,89 @@ private:
 
             RunSlotJavaScript(slotName);
         }, { .argCount = 1, .help = "run <slotNum> js"});
+
+        Shell::AddCommand("app.ss.cc.sensors", [&](vector<string> argList){
+            if (argList.size() >= 1 && argList[0] == "clear")
+            {
+                sensorCache_.Clear();
+            }
+            else if (argList.size() >= 2 && argList[0] == "maxage")
+            {
+                string err;
+                if (sensorCache_.SetMaxAgeMs(argList[1], err) == false)
+                {
+                    Log("ERR: ", err);
+                }
+                else
+                {
+                    sensorCache_.Save();
+                }
+            }
+            else if (argList.size() >= 1)
+            {
+                PrefetchSlotSensors(string{"slot"} + argList[0]);
+            }
+
+            sensorCache_.Print();
+        }, { .argCount = -1, .help = "show sensor cache, or [<slotNum>] prefetch, or [clear], or [maxage <ms>]"});
+
+        Shell::AddCommand("app.ss.cc.math", [&](vector<string> argList){
+            JSMath::Test();
+        }, { .argCount = 0, .help = "check native math accuracy and speed"});
+
+        Shell::AddCommand("app.ss.cc.store", [&](vector<string> argList){
+            if (argList.size() >= 1 && argList[0] == "clear")
+            {
+                kvStore_.Clear();
+            }
+            else if (argList.size() >= 2 && argList[0] == "persist")
+            {
+                kvStore_.SetPersist(atoi(argList[1].c_str()));
+            }
+            else if (argList.size() >= 1 && argList[0] == "flush")
+            {
+                kvStore_.Flush();
+            }
+
+            kvStore_.Print();
+        }, { .argCount = -1, .help = "show script store, or [clear], or [persist <0/1>], or [flush]"});
+
+        Shell::AddCommand("app.ss.cc.rec", [&](vector<string> argList){
+            if (argList.size() >= 1 && (argList[0] == "on" || argList[0] == "off"))
+            {
+                inputRecorder_.SetEnabled(argList[0] == "on");
+            }
+            else if (argList.size() >= 1 && argList[0] == "clear")
+            {
+                inputRecorder_.Clear();
+            }
+            else if (argList.size() >= 1 && argList[0] == "flush")
+            {
+                inputRecorder_.Flush();
+            }
+
+            inputRecorder_.Print();
+        }, { .argCount = -1, .help = "show recorded script inputs, or [on|off], or [clear], or [flush]"});
+
+        Shell::AddCommand("app.ss.cc.replay", [&](vector<string> argList){
+            uint16_t idx = argList.size() >= 1 ? atoi(argList[0].c_str()) : 0;
+
+            JSInputRecorder::Recording rec;
+            if (inputRecorder_.GetRecording(idx, rec) == false)
+            {
+                Log("No recording ", idx);
+                return;
+            }
+
+            string script = CopilotControlConfiguration::GetJavaScript(rec.slotName);
+
+            Log("Replaying ", rec.slotName, ", ", rec.kvList.size(), " values, script ", JSInputRecorder::Hash(script) == rec.scriptHash ? "unchanged" : "changed");
+
+            JavaScriptRunResult result = RunSlotJavaScriptCustomScript(rec.slotName, script, { .replay = &rec });
+
+            Log("Misses: ", result.replayMissCount);
+            Log("Msg   : ", result.msgStateStr);
+        }, { .argCount = -1, .help = "re-run recorded script inputs [<idx>] (0 is latest) with the slot's script"});
     }
 
     void SetupJSON()
@@ -358,9 +636,12 @@ private:
             string name   = (const char *)in["name"];
             string script = (const char *)in["script"];
 
-            Log("REQ_RUN_JS - ", name);
+            // optionally, where the time goes, with some overhead
+            bool profile = (bool)in["profile"];
+
+            Log("REQ_RUN_JS - ", name, profile ? " (profiled)" : "");
 
-            JavaScriptRunResult result = RunSlotJavaScriptCustomScript(name, script);
+            JavaScriptRunResult result = RunSlotJavaScriptCustomScript(name, script, { .cpuProfile = profile });
 
             // give user a view of what they have influence over, not the underlying
             // actual capacity of the system.
@@ -392,6 +673,239 @@ private:
             out["usesAPIGPS"]  = usesAPIGPS;
             out["usesAPIMsg"]  = usesAPIMsg;
             out["msgState"]    = result.msgStateStr;
+
+            if (profile)
+            {
+                out["profile"] = result.cpuProfile.ToString(script);
+                result.cpuProfile.ToJson(out["profileData"]);
+            }
+        });
+
+        JSONMsgRouter::RegisterHandler("REQ_GET_SENSOR_CACHE", [this](auto &in, auto &out){
+            out["type"] = "REP_GET_SENSOR_CACHE";
+
+            out["maxAgeMs"] = sensorCache_.GetMaxAgeMs();
+        });
+
+        JSONMsgRouter::RegisterHandler("REQ_SET_SENSOR_CACHE", [this](auto &in, auto &out){
+            out["type"] = "REP_SET_SENSOR_CACHE";
+
+            uint32_t maxAgeMs = (uint32_t)in["maxAgeMs"];
+
+            Log("REQ_SET_SENSOR_CACHE: ", maxAgeMs, " ms");
+
+            bool ok = true;
+            string err;
+
+            if (sensorCache_.SetMaxAgeMs(to_string(maxAgeMs), err) == false)
+            {
+                ok = false;
+            }
+            else if (sensorCache_.Save() == false)
+            {
+                ok = false;
+                err = "Could not store to flash";
+            }
+
+            out["ok"]  = ok;
+            out["err"] = err;
+        });
+
+        JSONMsgRouter::RegisterHandler("REQ_GET_JS_STORE", [this](auto &in, auto &out){
+            out["type"] = "REP_GET_JS_STORE";
+
+            out["persist"] = kvStore_.GetPersist();
+            for (const auto &[key, val] : kvStore_.GetKvMap())
+            {
+                if (val.isNumber)
+                {
+                    out["store"][key] = val.num;
+                }
+                else
+                {
+                    out["store"][key] = val.str;
+                }
+            }
+        });
+
+        JSONMsgRouter::RegisterHandler("REQ_SET_JS_STORE", [this](auto &in, auto &out){
+            out["type"] = "REP_SET_JS_STORE";
+
+            bool persist = (bool)in["persist"];
+            bool clear   = (bool)in["clear"];
+
+            Log("REQ_SET_JS_STORE: persist ", persist, ", clear ", clear);
+
+            if (clear)
+            {
+                kvStore_.Clear();
+            }
+            kvStore_.SetPersist(persist);
+
+            out["ok"] = true;
+        });
+
+        JSONMsgRouter::RegisterHandler("REQ_GET_JS_RECORDING", [this](auto &in, auto &out){
+            out["type"] = "REP_GET_JS_RECORDING";
+
+            out["enabled"]   = inputRecorder_.GetEnabled();
+            out["recording"] = inputRecorder_.GetRecordingText();
+        });
+
+        JSONMsgRouter::RegisterHandler("REQ_SET_JS_RECORDING", [this](auto &in, auto &out){
+            out["type"] = "REP_SET_JS_RECORDING";
+
+            bool enabled = (bool)in["enabled"];
+            bool clear   = (bool)in["clear"];
+
+            Log("REQ_SET_JS_RECORDING: enabled ", enabled, ", clear ", clear);
+
+            if (clear)
+            {
+                inputRecorder_.Clear();
+            }
+            inputRecorder_.SetEnabled(enabled);
+
+            out["ok"] = true;
+        });
+
+        // re-run a recorded slot script run with the inputs it saw, to
+        // compare scripts against. The recording is the one at index (0 is
+        // latest), or one line of recording text sent. The script is the
+        // slot's, or the one sent.
+        JSONMsgRouter::RegisterHandler("REQ_REPLAY_JS", [this](auto &in, auto &out){
+            out["type"] = "REP_REPLAY_JS";
+
+            const char *recordingIn = (const char *)in["recording"];
+            const char *scriptIn    = (const char *)in["script"];
+            uint16_t    idx         = (uint16_t)in["index"];
+
+            JSInputRecorder::Recording rec;
+            bool ok = recordingIn ? JSInputRecorder::FromLine(recordingIn, rec) : inputRecorder_.GetRecording(idx, rec);
+
+            out["ok"] = ok;
+
+            if (ok)
+            {
+                string script = scriptIn ? scriptIn : CopilotControlConfiguration::GetJavaScript(rec.slotName);
+
+                Log("REQ_REPLAY_JS - ", rec.slotName, ", ", rec.kvList.size(), " values");
+
+                JavaScriptRunResult result = RunSlotJavaScriptCustomScript(rec.slotName, script, { .replay = &rec });
+
+                out["name"]          = rec.slotName;
+                out["scriptChanged"] = JSInputRecorder::Hash(script) != rec.scriptHash;
+                out["parseOk"]       = result.parseOk;
+                out["parseErr"]      = result.parseErr;
+                out["runOk"]         = result.runOk;
+                out["runErr"]        = result.runErr;
+                out["runOutput"]     = result.runOutput;
+                out["missCount"]     = result.replayMissCount;
+                out["msgState"]      = result.msgStateStr;
+            }
+        });
+
+        // a run with a breakdown of the heap, less what the VM and bindings
+        // use, for sizing the heap to what scripts need
+        JSONMsgRouter::RegisterHandler("REQ_PROFILE_JS", [this](auto &in, auto &out){
+            string name   = (const char *)in["name"];
+            string script = (const char *)in["script"];
+
+            Log("REQ_PROFILE_JS - ", name);
+
+            JavaScriptRunResult result = RunSlotJavaScriptCustomScript(name, script, { .heapProfile = true });
+
+            JSHeapProfile heapUser = result.heapProfile;
+            heapUser.SubtractBaseline(heapProfileBaseline_);
+
+            Log("Heap (total):");
+            result.heapProfile.Print();
+            Log("Heap (script):");
+            heapUser.Print();
+
+            out["type"]     = "REP_PROFILE_JS";
+            out["name"]     = name;
+            out["parseOk"]  = result.parseOk;
+            out["parseErr"] = result.parseErr;
+            out["runOk"]    = result.runOk;
+            out["runErr"]   = result.runErr;
+            out["runMs"]    = result.runMs;
+
+            result.heapProfile.ToJson(out["heapTotal"]);
+            heapUser.ToJson(out["heapScript"]);
+
+            // heap that would fit this script, with a margin, in whole KB
+            uint32_t heapSuggested = result.heapProfile.heapPeak * 5 / 4;
+            out["heapSuggested"] = (heapSuggested + 1'023) / 1'024 * 1'024;
+        });
+
+        // check a script before it is stored for flight, by dry running it
+        // against the slot's message definition with an example gps fix and
+        // sensors which aren't there
+        JSONMsgRouter::RegisterHandler("REQ_VALIDATE_JS", [this](auto &in, auto &out){
+            string name   = (const char *)in["name"];
+            string script = (const char *)in["script"];
+
+            Log("REQ_VALIDATE_JS - ", name);
+
+            JavaScriptRunResult result = RunSlotJavaScriptCustomScript(name, script, { .heapProfile = true, .validate = true });
+
+            const vector<string> &fieldList = CopilotControlMessageDefinition::GetMsgLastConfigured().GetFieldList();
+
+            vector<string> fieldNotSetList;
+            for (const auto &fieldName : fieldList)
+            {
+                if (find(result.fieldSetList.begin(), result.fieldSetList.end(), fieldName) == result.fieldSetList.end())
+                {
+                    fieldNotSetList.push_back(fieldName);
+                }
+            }
+
+            bool ok = result.parseOk && result.runOk && result.unknownApiList.empty();
+
+            Log("Valid      : ", ok);
+            Log("Fields set : ", result.fieldSetList.size(), " / ", fieldList.size());
+            for (const auto &fieldName : fieldNotSetList)
+            {
+                Log("- not set  : ", fieldName);
+            }
+            for (const auto &use : result.unknownApiList)
+            {
+                Log("- unknown  : ", use);
+            }
+
+            out["type"]     = "REP_VALIDATE_JS";
+            out["name"]     = name;
+            out["ok"]       = ok;
+            out["parseOk"]  = result.parseOk;
+            out["parseErr"] = result.parseErr;
+            out["runOk"]    = result.runOk;
+            out["runErr"]   = result.runErr;
+
+            for (size_t i = 0; i < fieldList.size(); ++i)
+            {
+                out["fieldsDefined"][i] = fieldList[i];
+            }
+            for (size_t i = 0; i < result.fieldSetList.size(); ++i)
+            {
+                out["fieldsSet"][i] = result.fieldSetList[i];
+            }
+            for (size_t i = 0; i < fieldNotSetList.size(); ++i)
+            {
+                out["fieldsNotSet"][i] = fieldNotSetList[i];
+            }
+            for (size_t i = 0; i < result.unknownApiList.size(); ++i)
+            {
+                out["unknownApi"][i] = result.unknownApiList[i];
+            }
+
+            // cost, with sensors answering at once, so less time than a real run
+            JSHeapProfile heapUser = result.heapProfile;
+            heapUser.SubtractBaseline(heapProfileBaseline_);
+
+            out["runMs"]      = result.runMs;
+            out["heapUsed"]   = heapUser.heapPeak;
+            out["heapAvail"]  = result.runMemAvail - runMemUsedBaseline_;
         });
     }
 
@@ -400,5 +914,13 @@ private:
 
     static inline const uint64_t SCRIPT_TIME_LIMIT_MS = 1'000;
 
+    static inline const GpsSatStats *satStats_ = nullptr;
+
     uint32_t runMemUsedBaseline_ = 0;
+    JSHeapProfile heapProfileBaseline_;
+
+    JSSensorCache sensorCache_;
+    JSKvStore     kvStore_;
+
+    JSInputRecorder inputRecorder_;
 };
\ No newline at end of file
@@ -8,6 +8,7 @@
 #include "Log.h"
 #include "Shell.h"
 #include "TimeClass.h"
+#include "TimeDiscipline.h"
 #include "Timeline.h"
 #include "Utl.h"
 
@@ -205,6 +206,14 @@ private:
     function<void()> fnCbStartRadioWarmup_  = []{};
     function<void()> fnCbStopRadio_         = []{};
 
+    static const uint64_t DURATION_WARMUP_DEFAULT_US = 30 * 1'000 * 1'000;
+    static const uint64_t DURATION_WARMUP_MIN_US     =  5 * 1'000 * 1'000;
+
+    // time set aside ahead of the warmup for reading sensors ahead
+    static const uint64_t DURATION_SENSOR_PREFETCH_MAX_US = 2 * 1'000 * 1'000;
+
+    function<uint64_t()> fnCbGetWarmupDurationUs_ = []{ return DURATION_WARMUP_DEFAULT_US; };
+
     bool RadioIsActive()
     {
         if (IsTesting() == false)
@@ -227,6 +236,19 @@ private:
         }
     }
 
+    // Testing uses the default so that schedules are reproducible
+    uint64_t GetWarmupDurationUs()
+    {
+        uint64_t retVal = DURATION_WARMUP_DEFAULT_US;
+
+        if (IsTesting() == false)
+        {
+            retVal = max(fnCbGetWarmupDurationUs_(), DURATION_WARMUP_MIN_US);
+        }
+
+        return retVal;
+    }
+
     void StopRadio()
     {
         Mark("DISABLE_RADIO");
@@ -254,6 +276,13 @@ public:
         fnCbStopRadio_ = fn;
     }
 
+    // How long before the window the radio should be started.
+    // Floored at a minimum, defaults to 30 seconds when not set.
+    void SetCallbackGetWarmupDurationUs(function<uint64_t()> fn)
+    {
+        fnCbGetWarmupDurationUs_ = fn;
+    }
+
 
     /////////////////////////////////////////////////////////////////
     // Callback Setting - Speed Settings
@@ -310,6 +339,11 @@ public:
         startMin_ = startMin;
     }
 
+    const TimeDiscipline &GetTimeDiscipline() const
+    {
+        return timeDiscipline_;
+    }
+
 
 
     /////////////////////////////////////////////////////////////////
@@ -599,6 +633,16 @@ private:
 
         inLockout_ = false;
 
+        // the window's sensor readings are done with
+        js_.ClearSensorCache();
+
+        // save what scripts stored, and saw, during the window
+        if (IsTesting() == false)
+        {
+            js_.FlushStore();
+            js_.FlushInputRecording();
+        }
+
         // run at 48MHz?
 
         // apply cached data
@@ -787,11 +831,19 @@ private:
         // we know that the notional time is sync'd to gps.
         // use the current time to get the gps time, and use that to calculate time
         // at next window.
-        auto t = Time::ParseDateTime(Time::GetNotionalDateTimeAtSystemUs(timeNowUs));
+        //
+        // the system clock has drifted since the sync, so take out the drift
+        // accumulated so far to get gps time now, and allow for the drift to
+        // come before the window starts.
+        uint64_t sinceSyncUs = timeNowUs - Time::GetSystemUsAtLastTimeChange();
+        int64_t  driftUs     = timeDiscipline_.GetDriftUs(sinceSyncUs);
+
+        auto t = Time::ParseDateTime(Time::GetNotionalDateTimeAtSystemUs(timeNowUs - driftUs));
 
         // calculate window start
         uint64_t timeAtWindowStartUs =
             CalculateTimeAtWindowStartUs(startMin_, t.minute, t.second, t.us, timeNowUs);
+        timeAtWindowStartUs = timeNowUs + timeDiscipline_.ToSystemDurationUs(timeAtWindowStartUs - timeNowUs);
 
         // return timeNowUs used if requested
         if (timeNowUsRet) { *timeNowUsRet = timeNowUs; }
@@ -1111,7 +1163,6 @@ public: // for test running
 
         // named durations
         const uint64_t DURATION_ONE_SECOND_US     =      1 * 1'000 * 1'000;
-        const uint64_t DURATION_THIRTY_SECONDS_US =     30 * 1'000 * 1'000;
         const uint64_t DURATION_TWO_MINUTES_US    = 2 * 60 * 1'000 * 1'000;
 
         uint64_t DURATION_AVAIL_PRE_WINDOW_US = timeAtWindowStartUs - timeNowUs;
@@ -1131,15 +1182,21 @@ public: // for test running
         // the lockout period will protect more sensitive activities.
         //
         // No need to schedule if no transmissions will occur.
-        const uint64_t DURATION_WANT_WARMUP_US = DURATION_THIRTY_SECONDS_US;
-        const uint64_t DURATION_USE_WARMUP_US  = min(DURATION_WANT_WARMUP_US, DURATION_AVAIL_PRE_WINDOW_US);
-        const uint64_t TIME_AT_WARMUP_US       = timeAtWindowStartUs - DURATION_USE_WARMUP_US;
+        //
+        // Sensor prefetch runs first, before the radio starts, so it gets
+        // its own time ahead of the warmup, and is kept to it. Testing
+        // leaves it out so that schedules are reproducible.
         bool DO_WARMUP = false;
         if (PeriodWillTransmit(1)) { DO_WARMUP = true; }
         if (PeriodWillTransmit(2)) { DO_WARMUP = true; }
         if (PeriodWillTransmit(3)) { DO_WARMUP = true; }
         if (PeriodWillTransmit(4)) { DO_WARMUP = true; }
         if (PeriodWillTransmit(5)) { DO_WARMUP = true; }
+        const bool     DO_PREFETCH             = DO_WARMUP && IsTesting() == false && GetSensorPrefetchSlotNameList().size();
+        const uint64_t DURATION_PREFETCH_US    = DO_PREFETCH ? DURATION_SENSOR_PREFETCH_MAX_US : 0;
+        const uint64_t DURATION_WANT_WARMUP_US = GetWarmupDurationUs() + DURATION_PREFETCH_US;
+        const uint64_t DURATION_USE_WARMUP_US  = min(DURATION_WANT_WARMUP_US, DURATION_AVAIL_PRE_WINDOW_US);
+        const uint64_t TIME_AT_WARMUP_US       = timeAtWindowStartUs - DURATION_USE_WARMUP_US;
 
 
         // duration required for initial JS
@@ -1234,14 +1291,15 @@ public: // for test running
         // Setup warmup.
         if (DO_WARMUP)
         {
-            timerTxWarmup_.SetCallback([this]{
+            timerTxWarmup_.SetCallback([this, DURATION_PREFETCH_US]{
                 Mark("TX_WARMUP");
+                PrefetchSlotSensors(DURATION_PREFETCH_US);
                 StartRadioWarmup();
                 LogNL();
             });
             timerTxWarmup_.TimeoutAtUs(TIME_AT_WARMUP_US);
             Log("Scheduled ", TimeAt(TIME_AT_WARMUP_US), " for TX_WARMUP");
-            Log("    ", Time::MakeDurationFromUs(DURATION_WANT_WARMUP_US), " early wanted");
+            Log("    ", Time::MakeDurationFromUs(DURATION_WANT_WARMUP_US), " early wanted (", Time::MakeDurationFromUs(DURATION_PREFETCH_US), " sensor prefetch)");
             Log("    ", Time::MakeDurationFromUs(DURATION_AVAIL_PRE_WINDOW_US), " early was possible");
             Log("    ", Time::MakeDurationFromUs(DURATION_USE_WARMUP_US), " early used");
         }
@@ -1374,6 +1432,65 @@ public: // for test running
     // JavaScript Execution
     /////////////////////////////////////////////////////////////////
 
+    // Slots of the window whose scripts read sensors which can be read
+    // ahead (see JSSensorCache)
+    vector<string> GetSensorPrefetchSlotNameList()
+    {
+        vector<string> retVal;
+
+        for (SlotState *slotState : { &slotState1_, &slotState2_, &slotState3_, &slotState4_, &slotState5_ })
+        {
+            string slotName = string{"slot"} + to_string(slotState->slot);
+
+            if (slotState->slotBehavior.runJs && js_.GetSlotScriptAPIUsage(slotName).sensorPrefetch)
+            {
+                retVal.push_back(slotName);
+            }
+        }
+
+        return retVal;
+    }
+
+    // Read the sensors the window's slot scripts use while the radio is
+    // still off, so their runs use the readings rather than waiting on
+    // sensor conversions (see JSSensorCache).
+    //
+    // Kept to durationMaxUs. A slot's prefetch only starts if the script
+    // time limit fits in the time left, and that limit stops a run which
+    // goes over. Slots left out just read their sensors when they run.
+    void PrefetchSlotSensors(uint64_t durationMaxUs)
+    {
+        if (IsTestingJsDisabled()) { return; }
+
+        vector<string> slotNameList = GetSensorPrefetchSlotNameList();
+
+        if (slotNameList.empty() || durationMaxUs == 0) { return; }
+
+        Mark("JS_SENSOR_PREFETCH");
+
+        uint64_t timeAtDeadlineUs = PAL.Micros() + durationMaxUs;
+
+        // change to 48MHz
+        GoHighSpeed();
+
+        for (const auto &slotName : slotNameList)
+        {
+            uint64_t durationJsUs = js_.GetScriptTimeLimitMs() * 1'000;
+
+            if (PAL.Micros() + durationJsUs > timeAtDeadlineUs)
+            {
+                Log("Sensor prefetch: no time left for ", slotName);
+                continue;
+            }
+
+            js_.PrefetchSlotSensors(slotName, &scheduleDataActive_.gpsFix3DPlus);
+        }
+
+        // change to 6MHz
+        GoLowSpeed();
+    }
+
+
     bool RunSlotJavaScript(const string &slotName)
     {
         bool retVal = true;
@@ -1588,6 +1705,7 @@ public: // for test running
         Log("Scheduler Status");
         Log("---------------------------------------------");
         Log("Time Now         : ", Time::GetNotionalDateTimeAtSystemUs(timeNowUs));
+        Log("Time Drift       : ", ToString(timeDiscipline_.GetRatePpm(), 2), " ppm", timeDiscipline_.IsTrusted() ? "" : " (not in use)");
         Log("Start/Stop Status: ", running_ ? "Started" : "Stopped");
         if (running_)
         {
@@ -1636,6 +1754,9 @@ public: // for test running
     void SetTesting(bool tf)
     {
         testing_ = tf;
+
+        // test time is fake, don't learn from it or let it skew timing
+        timeDiscipline_.SetEnabled(tf == false);
     }
 
     bool IsTesting()
@@ -1832,6 +1953,8 @@ public: // for test running
             {
                 Log("    Prior time was running slow by ", Time::MakeDurationFromUs((uint64_t)offsetRelativeUs));
             }
+
+            timeDiscipline_.OnSync(offsetRelativeUs, timeAtGpsFixTimeSetUs - oldTimeNowUs);
         }
     }
 
@@ -1992,5 +2115,7 @@ public: // for test running
 
     Timeline t_;
 
+    TimeDiscipline timeDiscipline_;
+
     CopilotControlJavaScript js_;
 };
\ No newline at end of file
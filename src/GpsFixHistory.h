@@ -0,0 +1,232 @@
+#pragma once
+
+#include "GPS.h"
+#include "Log.h"
+#include "Utl.h"
+
+#include <array>
+#include <cmath>
+#include <string>
+using namespace std;
+
+
+// Keeps a bounded history of recent 3D fixes and dead-reckons a position
+// from them for windows where no new fix was acquired (coasting).
+//
+// The estimate is the last fix moved along its course at its speed for
+// the time elapsed since. When the module reported no motion, the
+// velocity between the last two fixes is used instead, as course and
+// speed are unreliable at low speed.
+//
+// Distances over a few windows are small, so a flat-earth projection
+// around the last fix is accurate enough for a 6-char grid.
+class GpsFixHistory
+{
+public:
+
+    struct Sample
+    {
+        uint64_t timeAtPpsUs = 0;
+        double   latDeg      = 0;
+        double   lngDeg      = 0;
+        int32_t  altM        = 0;
+        double   speedMps    = 0;
+        double   courseDeg   = 0;
+    };
+
+    struct Estimate
+    {
+        double   latDeg     = 0;
+        double   lngDeg     = 0;
+        int32_t  altM       = 0;
+        uint32_t speedKnots = 0;
+        uint32_t ageSec     = 0;
+        string   grid;
+    };
+
+
+public:
+
+    void Add(const Fix3DPlus &fix)
+    {
+        Sample s;
+        s.timeAtPpsUs = fix.timeAtPpsUs;
+        s.latDeg      = fix.latDegMillionths / 1'000'000.0;
+        s.lngDeg      = fix.lngDegMillionths / 1'000'000.0;
+        s.altM        = fix.altitudeM;
+        s.speedMps    = fix.speedKnots * MPS_PER_KNOT;
+        s.courseDeg   = fix.courseDegrees;
+
+        sampleList_[idxNext_] = s;
+        idxNext_ = (idxNext_ + 1) % SAMPLE_COUNT_MAX;
+        if (count_ < SAMPLE_COUNT_MAX)
+        {
+            ++count_;
+        }
+    }
+
+    void Clear()
+    {
+        count_   = 0;
+        idxNext_ = 0;
+    }
+
+    uint8_t Size() const
+    {
+        return count_;
+    }
+
+    // 0 is the most recent
+    const Sample &Get(uint8_t idx) const
+    {
+        return sampleList_[(idxNext_ + SAMPLE_COUNT_MAX - 1 - idx) % SAMPLE_COUNT_MAX];
+    }
+
+    // Returns false if there is no fix recent enough to estimate from
+    bool GetEstimate(uint64_t timeNowUs, Estimate &est) const
+    {
+        if (count_ == 0)
+        {
+            return false;
+        }
+
+        const Sample &last = Get(0);
+
+        if (timeNowUs < last.timeAtPpsUs)
+        {
+            return false;
+        }
+
+        double ageSec = (timeNowUs - last.timeAtPpsUs) / 1'000'000.0;
+        if (ageSec > MAX_AGE_SEC)
+        {
+            return false;
+        }
+
+        // velocity, in m/s north and east
+        double vn = 0;
+        double ve = 0;
+
+        if (last.speedMps >= MIN_REPORTED_SPEED_MPS)
+        {
+            double courseRad = last.courseDeg * DEG_TO_RAD;
+
+            vn = last.speedMps * cos(courseRad);
+            ve = last.speedMps * sin(courseRad);
+        }
+        else if (count_ >= 2)
+        {
+            const Sample &prev = Get(1);
+
+            double dtSec = (last.timeAtPpsUs - prev.timeAtPpsUs) / 1'000'000.0;
+            if (last.timeAtPpsUs > prev.timeAtPpsUs && dtSec <= MAX_AGE_SEC)
+            {
+                vn = (last.latDeg - prev.latDeg) * METERS_PER_DEG_LAT / dtSec;
+                ve = (last.lngDeg - prev.lngDeg) * MetersPerDegLng(last.latDeg) / dtSec;
+            }
+        }
+
+        // guard against a bad sample sending the estimate far away
+        double speedMps = sqrt(vn * vn + ve * ve);
+        if (speedMps > MAX_SPEED_MPS)
+        {
+            vn *= MAX_SPEED_MPS / speedMps;
+            ve *= MAX_SPEED_MPS / speedMps;
+            speedMps = MAX_SPEED_MPS;
+        }
+
+        est.latDeg = last.latDeg + vn * ageSec / METERS_PER_DEG_LAT;
+        est.lngDeg = last.lngDeg + ve * ageSec / MetersPerDegLng(last.latDeg);
+
+        // keep in range
+        if (est.latDeg >  89.999) { est.latDeg =  89.999; }
+        if (est.latDeg < -89.999) { est.latDeg = -89.999; }
+        if (est.lngDeg >= 180)    { est.lngDeg -= 360;    }
+        if (est.lngDeg < -180)    { est.lngDeg += 360;    }
+
+        est.altM       = last.altM;
+        est.speedKnots = (uint32_t)round(speedMps / MPS_PER_KNOT);
+        est.ageSec     = (uint32_t)ageSec;
+        est.grid       = MakeMaidenheadGrid6(est.latDeg, est.lngDeg);
+
+        return true;
+    }
+
+    static string MakeMaidenheadGrid6(double latDeg, double lngDeg)
+    {
+        double lng = lngDeg + 180;
+        double lat = latDeg + 90;
+
+        char buf[7];
+        buf[0] = 'A' + (int)(lng / 20);
+        buf[1] = 'A' + (int)(lat / 10);
+        buf[2] = '0' + (int)(fmod(lng, 20) / 2);
+        buf[3] = '0' + (int)(fmod(lat, 10) / 1);
+        buf[4] = 'a' + (int)(fmod(lng, 2) * 12);
+        buf[5] = 'a' + (int)(fmod(lat, 1) * 24);
+        buf[6] = '\0';
+
+        return buf;
+    }
+
+    void Print(uint64_t timeNowUs) const
+    {
+        Log("Fix history (", count_, " samples)");
+        for (uint8_t i = 0; i < count_; ++i)
+        {
+            const Sample &s = Get(i);
+
+            Log("- ", Commas((timeNowUs - s.timeAtPpsUs) / 1'000'000), " sec ago: ",
+                s.latDeg, ", ", s.lngDeg, ", ", s.altM, " m, ",
+                s.speedMps, " m/s, ", s.courseDeg, " deg");
+        }
+
+        Estimate est;
+        if (GetEstimate(timeNowUs, est))
+        {
+            Log("Estimate: ", est.grid, " (", est.latDeg, ", ", est.lngDeg, "), age ", est.ageSec, " sec");
+        }
+        else
+        {
+            Log("Estimate: none");
+        }
+    }
+
+
+private:
+
+    static const uint8_t SAMPLE_COUNT_MAX = 8;
+
+    // a coast beyond this has given up on the GPS anyway
+    static constexpr double MAX_AGE_SEC = 35 * 60;
+
+    // below this the module course isn't trusted
+    static constexpr double MIN_REPORTED_SPEED_MPS = 1.0;
+
+    // well above any jet stream a balloon will ride
+    static constexpr double MAX_SPEED_MPS = 120.0;
+
+    static constexpr double MPS_PER_KNOT       = 0.514444;
+    static constexpr double METERS_PER_DEG_LAT = 111'320.0;
+    static constexpr double DEG_TO_RAD         = M_PI / 180.0;
+
+    static double MetersPerDegLng(double latDeg)
+    {
+        double retVal = METERS_PER_DEG_LAT * cos(latDeg * DEG_TO_RAD);
+
+        // avoid blowing up at the poles
+        if (retVal < 1'000)
+        {
+            retVal = 1'000;
+        }
+
+        return retVal;
+    }
+
+
+private:
+
+    array<Sample, SAMPLE_COUNT_MAX> sampleList_;
+    uint8_t idxNext_ = 0;
+    uint8_t count_   = 0;
+};
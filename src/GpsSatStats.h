@@ -0,0 +1,425 @@
+#pragma once
+
+#include "Log.h"
+#include "Utl.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+using namespace std;
+
+
+// Summarizes the satellites in view per constellation from GSV sentences.
+//
+// Each epoch (once a second) the module sends a sequence of GSV messages
+// per constellation. Those are folded into running totals as they arrive
+// and published as a snapshot when the sequence completes, so no
+// satellite lists are stored. An out-of-sequence message discards the
+// partial epoch.
+//
+// GSV isn't exposed by GPSReader, so sentences are parsed here, from each
+// line from the GPS module. Lines of other types are turned away by their
+// sentence id, so the cost to lines GPSReader handles is a compare.
+class GpsSatStats
+{
+public:
+
+    enum class Constellation : uint8_t
+    {
+        GPS,
+        BEIDOU,
+        GLONASS,
+        GALILEO,
+        COUNT,
+    };
+
+    static const uint8_t CONSTELLATION_COUNT = (uint8_t)Constellation::COUNT;
+
+    // elevation bins are [0, 15), [15, 30), [30, 60), [60, 90]
+    static const uint8_t ELEV_BIN_COUNT = 4;
+
+    struct Stats
+    {
+        uint8_t inView  = 0;
+        uint8_t tracked = 0;    // in view with a C/N0
+        uint8_t cn0Mean = 0;    // over tracked, dB-Hz
+        uint8_t cn0Max  = 0;
+        array<uint8_t, ELEV_BIN_COUNT> elevBinList = {};
+
+        uint32_t epochCount    = 0;
+        uint64_t timeUpdatedUs = 0;
+    };
+
+    static const uint8_t LINE_LEN_MAX = 95;
+
+    // One message of a sequence describing the satellites in view of a
+    // single constellation (by talker id)
+    struct Gsv
+    {
+        static const uint8_t SAT_COUNT_MAX = 4;
+
+        struct Sat
+        {
+            uint8_t  id      = 0;
+            uint8_t  elevDeg = 0;
+            uint16_t azDeg   = 0;
+            uint8_t  cn0     = 0;   // dB-Hz, 0 when not tracked
+        };
+
+        // eg "GP", "GL"
+        char talker[3] = {};
+
+        uint8_t msgTotal = 0;
+        uint8_t msgNum   = 0;
+        uint8_t inView   = 0;
+        uint8_t satCount = 0;
+        Sat     satList[SAT_COUNT_MAX];
+    };
+
+
+
+public:
+
+    static bool IsGsv(const string &line)
+    {
+        return line.size() >= 6 && line[0] == '$' && line.compare(3, 3, "GSV") == 0;
+    }
+
+    // Returns true if the line is a checksum-valid GSV sentence, with the
+    // parsed content in gsv
+    static bool ParseGsv(const string &line, Gsv &gsv)
+    {
+        if (IsGsv(line) == false || line.size() > LINE_LEN_MAX)
+        {
+            return false;
+        }
+
+        // copy so that fields can be terminated in place
+        char buf[LINE_LEN_MAX + 1];
+        memcpy(buf, line.c_str(), line.size() + 1);
+
+        const char *fieldList[FIELD_COUNT_MAX];
+        uint8_t fieldCount = 0;
+
+        if (Split(buf, fieldList, fieldCount) == false || fieldCount < 4)
+        {
+            return false;
+        }
+
+        gsv = Gsv{};
+        gsv.talker[0] = fieldList[0][0];
+        gsv.talker[1] = fieldList[0][1];
+
+        double total  = 0;
+        double num    = 0;
+        double inView = 0;
+
+        if (ParseDecimal(fieldList[1], total) == false ||
+            ParseDecimal(fieldList[2], num)   == false ||
+            ParseDecimal(fieldList[3], inView) == false)
+        {
+            return false;
+        }
+
+        gsv.msgTotal = (uint8_t)total;
+        gsv.msgNum   = (uint8_t)num;
+        gsv.inView   = (uint8_t)inView;
+
+        // groups of 4 fields per satellite, possibly followed by a signal
+        // id field (NMEA 4.10+), which is ignored
+        for (uint8_t i = 4; i + 3 < fieldCount && gsv.satCount < Gsv::SAT_COUNT_MAX; i += 4)
+        {
+            double satId = 0;
+            double elev  = 0;
+            double az    = 0;
+            double cn0   = 0;
+
+            if (ParseDecimal(fieldList[i], satId) == false)
+            {
+                continue;
+            }
+
+            // elevation and azimuth can be blank for satellites known
+            // about but not yet located
+            ParseDecimal(fieldList[i + 1], elev);
+            ParseDecimal(fieldList[i + 2], az);
+            ParseDecimal(fieldList[i + 3], cn0);
+
+            Gsv::Sat &sat = gsv.satList[gsv.satCount];
+            sat.id      = (uint8_t)satId;
+            sat.elevDeg = (uint8_t)(elev < 0 ? 0 : elev);
+            sat.azDeg   = (uint16_t)az;
+            sat.cn0     = (uint8_t)cn0;
+
+            ++gsv.satCount;
+        }
+
+        return true;
+    }
+
+
+    void Reset()
+    {
+        for (auto &c : constList_)
+        {
+            c = {};
+        }
+    }
+
+    // Returns true if an epoch for the constellation just completed
+    bool OnGsv(const Gsv &gsv, uint64_t timeNowUs)
+    {
+        bool retVal = false;
+
+        Constellation con;
+        if (GetConstellationFromTalker(gsv.talker, con) == false)
+        {
+            return false;
+        }
+
+        ConstState &c = constList_[(uint8_t)con];
+
+        if (gsv.msgNum == 1)
+        {
+            c.acc = {};
+            c.accMsgNext = 1;
+        }
+
+        if (c.accMsgNext == 0 || gsv.msgNum != c.accMsgNext)
+        {
+            // out of sequence, wait for the next epoch
+            c.accMsgNext = 0;
+
+            return false;
+        }
+
+        c.acc.inView = gsv.inView;
+        for (uint8_t i = 0; i < gsv.satCount; ++i)
+        {
+            const auto &sat = gsv.satList[i];
+
+            if (sat.cn0)
+            {
+                ++c.acc.tracked;
+                c.acc.cn0Sum += sat.cn0;
+                if (sat.cn0 > c.acc.cn0Max)
+                {
+                    c.acc.cn0Max = sat.cn0;
+                }
+            }
+
+            ++c.acc.elevBinList[GetElevBin(sat.elevDeg)];
+        }
+
+        if (gsv.msgNum == gsv.msgTotal)
+        {
+            Stats &s = c.stats;
+
+            s.inView      = c.acc.inView;
+            s.tracked     = c.acc.tracked;
+            s.cn0Mean     = c.acc.tracked ? (uint8_t)((c.acc.cn0Sum + c.acc.tracked / 2) / c.acc.tracked) : 0;
+            s.cn0Max      = c.acc.cn0Max;
+            s.elevBinList = c.acc.elevBinList;
+
+            ++s.epochCount;
+            s.timeUpdatedUs = timeNowUs;
+
+            c.accMsgNext = 0;
+
+            retVal = true;
+        }
+        else
+        {
+            ++c.accMsgNext;
+        }
+
+        return retVal;
+    }
+
+    const Stats &Get(Constellation con) const
+    {
+        return constList_[(uint8_t)con].stats;
+    }
+
+    static const char *GetTalker(Constellation con)
+    {
+        const char *retVal = "";
+
+        switch (con)
+        {
+            case Constellation::GPS:     retVal = "GP"; break;
+            case Constellation::BEIDOU:  retVal = "BD"; break;
+            case Constellation::GLONASS: retVal = "GL"; break;
+            case Constellation::GALILEO: retVal = "GA"; break;
+            default: break;
+        }
+
+        return retVal;
+    }
+
+    static const char *GetElevBinName(uint8_t bin)
+    {
+        static const char *NAME_LIST[ELEV_BIN_COUNT] = { "Below15", "15To30", "30To60", "Above60" };
+
+        return bin < ELEV_BIN_COUNT ? NAME_LIST[bin] : "";
+    }
+
+    void Print() const
+    {
+        for (uint8_t i = 0; i < CONSTELLATION_COUNT; ++i)
+        {
+            const Stats &s = constList_[i].stats;
+
+            Log(GetTalker((Constellation)i), ": inView ", s.inView, ", tracked ", s.tracked,
+                ", cn0 mean ", s.cn0Mean, " max ", s.cn0Max,
+                ", elev [", s.elevBinList[0], ", ", s.elevBinList[1], ", ", s.elevBinList[2], ", ", s.elevBinList[3], "]",
+                ", epochs ", Commas(s.epochCount));
+        }
+    }
+
+
+private:
+
+    static const uint8_t FIELD_COUNT_MAX = 24;
+
+    // Checks the "$ttsss,...*hh" framing and checksum, then splits buf in
+    // place on commas. The first field is the sentence id, less the '$'.
+    static bool Split(char *buf, const char *fieldList[FIELD_COUNT_MAX], uint8_t &fieldCount)
+    {
+        char *star = strchr(buf, '*');
+        if (star == nullptr || star[1] == '\0' || star[2] == '\0')
+        {
+            return false;
+        }
+
+        uint8_t checksum = 0;
+        for (char *p = &buf[1]; p != star; ++p)
+        {
+            checksum ^= (uint8_t)*p;
+        }
+
+        int hi = HexVal(star[1]);
+        int lo = HexVal(star[2]);
+        if (hi < 0 || lo < 0 || checksum != (uint8_t)((hi << 4) | lo))
+        {
+            return false;
+        }
+
+        *star = '\0';
+
+        fieldCount = 0;
+        fieldList[fieldCount++] = &buf[1];
+        for (char *p = &buf[1]; *p != '\0' && fieldCount < FIELD_COUNT_MAX; ++p)
+        {
+            if (*p == ',')
+            {
+                *p = '\0';
+                fieldList[fieldCount++] = p + 1;
+            }
+        }
+
+        return strlen(fieldList[0]) == 5;
+    }
+
+    static int HexVal(char c)
+    {
+        int retVal = -1;
+
+        if      (c >= '0' && c <= '9') { retVal = c - '0';      }
+        else if (c >= 'A' && c <= 'F') { retVal = c - 'A' + 10; }
+        else if (c >= 'a' && c <= 'f') { retVal = c - 'a' + 10; }
+
+        return retVal;
+    }
+
+    // Simple fixed-notation decimal, no exponent, no locale
+    static bool ParseDecimal(const char *str, double &val)
+    {
+        bool neg = false;
+        if (*str == '-')
+        {
+            neg = true;
+            ++str;
+        }
+
+        bool   gotDigit = false;
+        double whole    = 0;
+        double scale    = 0;
+        for (; *str != '\0'; ++str)
+        {
+            if (*str >= '0' && *str <= '9')
+            {
+                gotDigit = true;
+
+                if (scale == 0)
+                {
+                    whole = whole * 10 + (*str - '0');
+                }
+                else
+                {
+                    whole += (*str - '0') * scale;
+                    scale /= 10;
+                }
+            }
+            else if (*str == '.' && scale == 0)
+            {
+                scale = 0.1;
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        val = neg ? -whole : whole;
+
+        return gotDigit;
+    }
+
+    static bool GetConstellationFromTalker(const char *talker, Constellation &con)
+    {
+        bool retVal = true;
+
+        if      (strcmp(talker, "GP") == 0) { con = Constellation::GPS;     }
+        else if (strcmp(talker, "BD") == 0) { con = Constellation::BEIDOU;  }
+        else if (strcmp(talker, "GB") == 0) { con = Constellation::BEIDOU;  }
+        else if (strcmp(talker, "GL") == 0) { con = Constellation::GLONASS; }
+        else if (strcmp(talker, "GA") == 0) { con = Constellation::GALILEO; }
+        else                                { retVal = false;               }
+
+        return retVal;
+    }
+
+    static uint8_t GetElevBin(uint8_t elevDeg)
+    {
+        uint8_t retVal = 3;
+
+        if      (elevDeg < 15) { retVal = 0; }
+        else if (elevDeg < 30) { retVal = 1; }
+        else if (elevDeg < 60) { retVal = 2; }
+
+        return retVal;
+    }
+
+
+private:
+
+    struct Accumulator
+    {
+        uint8_t  inView  = 0;
+        uint8_t  tracked = 0;
+        uint16_t cn0Sum  = 0;
+        uint8_t  cn0Max  = 0;
+        array<uint8_t, ELEV_BIN_COUNT> elevBinList = {};
+    };
+
+    struct ConstState
+    {
+        Stats       stats;
+        Accumulator acc;
+        uint8_t     accMsgNext = 0;    // 0 when not in a sequence
+    };
+
+    array<ConstState, CONSTELLATION_COUNT> constList_;
+};
@@ -0,0 +1,363 @@
+#pragma once
+
+#include "FilesystemLittleFS.h"
+#include "GPS.h"
+#include "Log.h"
+#include "Utl.h"
+
+#include "hardware/uart.h"
+#include "hardware/watchdog.h"
+
+#include <array>
+#include <cstring>
+#include <string>
+#include <vector>
+using namespace std;
+
+
+// Keeps enough GPS state across reboots to give the module a warm start.
+//
+// Two pieces of state are kept:
+// - the last good 3D position, persisted to flash, surviving any reboot
+//   (including brownouts).
+// - the GPS time, kept in the RP2040 watchdog scratch registers, which
+//   only survive a watchdog reboot (which is how the app restarts itself
+//   after giving up on the GPS).
+//
+// On the first GPS enable after boot, whatever was restored is sent to the
+// module as a CASIC AID-INI message (position and, when known, time).
+class GpsWarmStart
+{
+private:
+
+    inline static const char *FILE_NAME    = "gpswarm.txt";
+    inline static const char *FILE_VERSION = "v1";
+
+    // scratch 4-7 are used by the bootrom, 0-3 are free for the app
+    static const uint8_t  SCRATCH_IDX_MAGIC  = 0;
+    static const uint8_t  SCRATCH_IDX_SEC    = 1;
+    static const uint8_t  SCRATCH_IDX_SECINV = 2;
+    static const uint32_t SCRATCH_MAGIC      = 0x47505357;  // "GPSW"
+
+    static const uint32_t WATCHDOG_DELAY_SEC   = 3;
+    static const uint32_t SECONDS_PER_WEEK     = 7 * 86'400;
+    static const uint32_t GPS_UTC_LEAP_SECONDS = 18;
+
+    static const uint8_t AID_INI_CLASS       = 0x0B;
+    static const uint8_t AID_INI_ID          = 0x01;
+    static const size_t  AID_INI_PAYLOAD_LEN = 56;
+    static const size_t  AID_INI_MSG_LEN     = 6 + AID_INI_PAYLOAD_LEN + 4;
+
+
+public:
+
+    GpsWarmStart()
+    {
+        Restore();
+    }
+
+
+    /////////////////////////////////////////////////////////////////
+    // State capture
+    /////////////////////////////////////////////////////////////////
+
+    void OnFixTime(const FixTime &fix)
+    {
+        // time locks without a date can't be turned into GPS week/tow
+        uint32_t gpsSec = 0;
+        if (MakeGpsSecFromDateTime(fix.dateTime, gpsSec))
+        {
+            gpsSecAtRef_ = gpsSec;
+            timeAtRefUs_ = fix.timeAtPpsUs;
+        }
+    }
+
+    void OnFix3DPlus(const Fix3DPlus &fix)
+    {
+        OnFixTime(fix);
+
+        // only write to flash when the position changed enough to matter
+        // to the module, a warm start tolerates a position off by many km.
+        // always write once per boot so the stored position is never stale
+        // by more than one power cycle.
+        const int32_t ONE_HALF_DEG_MILLIONTHS = 500'000;
+
+        bool moved =
+            abs(fix.latDegMillionths - state_.latDegMillionths) >= ONE_HALF_DEG_MILLIONTHS ||
+            abs(fix.lngDegMillionths - state_.lngDegMillionths) >= ONE_HALF_DEG_MILLIONTHS;
+
+        state_.valid            = true;
+        state_.latDegMillionths = fix.latDegMillionths;
+        state_.lngDegMillionths = fix.lngDegMillionths;
+        state_.altitudeM        = fix.altitudeM;
+
+        if (savedThisBoot_ == false || moved)
+        {
+            savedThisBoot_ = Save();
+        }
+    }
+
+    // Call immediately before a deliberate watchdog reboot
+    void SaveTimeBeforeReboot()
+    {
+        if (timeAtRefUs_ == 0) { return; }
+
+        uint32_t gpsSecNow = gpsSecAtRef_ + (uint32_t)((PAL.Micros() - timeAtRefUs_) / 1'000'000);
+
+        watchdog_hw->scratch[SCRATCH_IDX_MAGIC]  = SCRATCH_MAGIC;
+        watchdog_hw->scratch[SCRATCH_IDX_SEC]    = gpsSecNow;
+        watchdog_hw->scratch[SCRATCH_IDX_SECINV] = ~gpsSecNow;
+
+        Log("GPS warm start: saved GPS time ", gpsSecNow, " for after reboot");
+    }
+
+
+    /////////////////////////////////////////////////////////////////
+    // Aiding
+    /////////////////////////////////////////////////////////////////
+
+    bool HasAidingData()
+    {
+        return state_.valid;
+    }
+
+    // Sends AID-INI to the module over UART1, which must already be enabled.
+    // Returns true if a message was sent.
+    bool SendAiding()
+    {
+        bool retVal = false;
+
+        if (state_.valid)
+        {
+            retVal = true;
+
+            bool timeValid = gpsSecAtBoot_ != 0;
+
+            // by the time this is called the clock has moved on from the
+            // time restored at boot
+            uint32_t gpsSecNow = gpsSecAtBoot_ + (uint32_t)(PAL.Micros() / 1'000'000);
+
+            array<uint8_t, AID_INI_MSG_LEN> buf = MakeAidIni(timeValid, gpsSecNow);
+            uart_write_blocking(uart1, buf.data(), buf.size());
+
+            Log("GPS warm start: sent aiding");
+            Log("- Lat : ", state_.latDegMillionths / 1'000'000.0);
+            Log("- Lng : ", state_.lngDegMillionths / 1'000'000.0);
+            Log("- AltM: ", state_.altitudeM);
+            if (timeValid)
+            {
+                Log("- Time: week ", gpsSecNow / SECONDS_PER_WEEK, ", tow ", gpsSecNow % SECONDS_PER_WEEK);
+            }
+            else
+            {
+                Log("- Time: unknown");
+            }
+        }
+
+        return retVal;
+    }
+
+    void Delete()
+    {
+        FilesystemLittleFS::Remove(FILE_NAME);
+
+        state_ = State{};
+        savedThisBoot_ = false;
+    }
+
+    void Print()
+    {
+        Log("GPS warm start state");
+        Log("- Position valid: ", state_.valid);
+        Log("- Lat           : ", state_.latDegMillionths / 1'000'000.0);
+        Log("- Lng           : ", state_.lngDegMillionths / 1'000'000.0);
+        Log("- AltM          : ", state_.altitudeM);
+        Log("- GPS sec @ boot: ", gpsSecAtBoot_);
+        Log("- GPS sec @ ref : ", gpsSecAtRef_);
+    }
+
+
+private:
+
+    /////////////////////////////////////////////////////////////////
+    // Persistence
+    /////////////////////////////////////////////////////////////////
+
+    struct State
+    {
+        bool    valid            = false;
+        int32_t latDegMillionths = 0;
+        int32_t lngDegMillionths = 0;
+        int32_t altitudeM        = 0;
+    };
+
+    void Restore()
+    {
+        // position, from flash
+        string data = FilesystemLittleFS::Read(FILE_NAME);
+        vector<string> partList = Split(data, " ");
+
+        if (partList.size() == 4 && partList[0] == FILE_VERSION)
+        {
+            state_.valid            = true;
+            state_.latDegMillionths = atoi(partList[1].c_str());
+            state_.lngDegMillionths = atoi(partList[2].c_str());
+            state_.altitudeM        = atoi(partList[3].c_str());
+        }
+
+        // time, from watchdog scratch, only meaningful on watchdog reboot
+        if (watchdog_caused_reboot() &&
+            watchdog_hw->scratch[SCRATCH_IDX_MAGIC] == SCRATCH_MAGIC &&
+            watchdog_hw->scratch[SCRATCH_IDX_SEC]   == ~watchdog_hw->scratch[SCRATCH_IDX_SECINV])
+        {
+            // the watchdog fires some time after the save, assume halfway
+            // through its timeout.
+            gpsSecAtBoot_ = watchdog_hw->scratch[SCRATCH_IDX_SEC] + WATCHDOG_DELAY_SEC;
+        }
+
+        // consume
+        watchdog_hw->scratch[SCRATCH_IDX_MAGIC] = 0;
+
+        Log("GPS warm start: position ", state_.valid ? "" : "not ", "restored, time ", gpsSecAtBoot_ ? "" : "not ", "restored");
+    }
+
+    bool Save()
+    {
+        string data;
+        data += FILE_VERSION;
+        data += " " + to_string(state_.latDegMillionths);
+        data += " " + to_string(state_.lngDegMillionths);
+        data += " " + to_string(state_.altitudeM);
+
+        bool retVal = FilesystemLittleFS::Write(FILE_NAME, data);
+
+        if (retVal == false)
+        {
+            Log("ERR: GPS warm start: could not save position");
+        }
+
+        return retVal;
+    }
+
+
+    /////////////////////////////////////////////////////////////////
+    // Time conversion
+    /////////////////////////////////////////////////////////////////
+
+    // Parses "YYYY-MM-DD HH:MM:SS[.fff]" into seconds since the GPS epoch
+    // (1980-01-06), including leap seconds.
+    static bool MakeGpsSecFromDateTime(const string &dateTime, uint32_t &gpsSec)
+    {
+        bool retVal = false;
+
+        if (dateTime.size() >= 19)
+        {
+            int year   = atoi(dateTime.substr( 0, 4).c_str());
+            int month  = atoi(dateTime.substr( 5, 2).c_str());
+            int day    = atoi(dateTime.substr( 8, 2).c_str());
+            int hour   = atoi(dateTime.substr(11, 2).c_str());
+            int minute = atoi(dateTime.substr(14, 2).c_str());
+            int second = atoi(dateTime.substr(17, 2).c_str());
+
+            if (year >= 2020 && month >= 1 && month <= 12 && day >= 1 && day <= 31)
+            {
+                retVal = true;
+
+                int64_t days = DaysFromCivil(year, month, day) - DaysFromCivil(1980, 1, 6);
+
+                gpsSec = (uint32_t)(days * 86'400 + hour * 3'600 + minute * 60 + second + GPS_UTC_LEAP_SECONDS);
+            }
+        }
+
+        return retVal;
+    }
+
+    // days since 1970-01-01 for a proleptic gregorian date
+    static int64_t DaysFromCivil(int y, int m, int d)
+    {
+        y -= m <= 2;
+        int64_t  era = (y >= 0 ? y : y - 399) / 400;
+        uint32_t yoe = (uint32_t)(y - era * 400);
+        uint32_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+        uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+        return era * 146'097 + (int64_t)doe - 719'468;
+    }
+
+
+    /////////////////////////////////////////////////////////////////
+    // CASIC AID-INI encoding
+    /////////////////////////////////////////////////////////////////
+
+    // Frame: BA CE <len:2> <class:1> <id:1> <payload:56> <checksum:4>
+    //
+    // Payload:
+    //   0 R8 lat (deg)    8 R8 lon (deg)   16 R8 alt (m)    24 R8 tow (s)
+    //  32 R4 df          36 R4 posAcc (m)  40 R4 tAcc (s)   44 R4 fAcc
+    //  48 U4 reserved    52 U2 week        54 U1 timeSource 55 U1 flags
+    //
+    // Flags:
+    //   bit 0 - position valid
+    //   bit 1 - time valid
+    //   bit 5 - position is lat/lon/alt (not ECEF)
+    array<uint8_t, AID_INI_MSG_LEN> MakeAidIni(bool timeValid, uint32_t gpsSecNow)
+    {
+        array<uint8_t, AID_INI_PAYLOAD_LEN> payload;
+        payload.fill(0);
+
+        double lat    = state_.latDegMillionths / 1'000'000.0;
+        double lng    = state_.lngDegMillionths / 1'000'000.0;
+        double alt    = state_.altitudeM;
+        double tow    = timeValid ? (double)(gpsSecNow % SECONDS_PER_WEEK) : 0;
+        float  posAcc = 100'000;    // 100km, the position may be hours old at altitude
+        float  tAcc   = timeValid ? (float)WATCHDOG_DELAY_SEC * 2 : 0;
+        uint16_t week = timeValid ? (uint16_t)(gpsSecNow / SECONDS_PER_WEEK) : 0;
+
+        uint8_t flags = 0;
+        flags |= (1 << 0);
+        flags |= timeValid ? (1 << 1) : 0;
+        flags |= (1 << 5);
+
+        // RP2040 is little endian, same as the wire format
+        memcpy(&payload[ 0], &lat,    sizeof(lat));
+        memcpy(&payload[ 8], &lng,    sizeof(lng));
+        memcpy(&payload[16], &alt,    sizeof(alt));
+        memcpy(&payload[24], &tow,    sizeof(tow));
+        memcpy(&payload[36], &posAcc, sizeof(posAcc));
+        memcpy(&payload[40], &tAcc,   sizeof(tAcc));
+        memcpy(&payload[52], &week,   sizeof(week));
+        payload[55] = flags;
+
+        // checksum is a sum of 32-bit words, seeded with the header
+        uint32_t checksum = ((uint32_t)AID_INI_ID << 24) + ((uint32_t)AID_INI_CLASS << 16) + AID_INI_PAYLOAD_LEN;
+        for (size_t i = 0; i < payload.size(); i += 4)
+        {
+            uint32_t word;
+            memcpy(&word, &payload[i], sizeof(word));
+            checksum += word;
+        }
+
+        array<uint8_t, AID_INI_MSG_LEN> buf;
+        buf[0] = 0xBA;
+        buf[1] = 0xCE;
+        buf[2] = (uint8_t)(AID_INI_PAYLOAD_LEN & 0xFF);
+        buf[3] = (uint8_t)(AID_INI_PAYLOAD_LEN >> 8);
+        buf[4] = AID_INI_CLASS;
+        buf[5] = AID_INI_ID;
+        memcpy(&buf[6], payload.data(), payload.size());
+        memcpy(&buf[6 + payload.size()], &checksum, sizeof(checksum));
+
+        return buf;
+    }
+
+
+private:
+
+    State state_;
+    bool savedThisBoot_ = false;
+
+    uint32_t gpsSecAtBoot_ = 0;
+
+    uint32_t gpsSecAtRef_ = 0;
+    uint64_t timeAtRefUs_ = 0;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+#include <vector>
+using namespace std;
+
+
+// One wrapper around the script bindings, which features (the input
+// recorder, the sensor cache, the dry-run check, the profiler) hook into,
+// rather than each wrapping the bindings again by itself.
+//
+// A hook is a one-line ES5 prelude which pushes an object onto __hk:
+//   o     : names of the global objects (gps, msg, ...) to hook methods on
+//   C     : truthy to hook methods on constructed objects (I2C, BME280, ...)
+//   D     : truthy to hook DelayMs
+//   call  : function(w, k, a, next), for a call of method k with arguments
+//           a, on w.n (eg "DS18X(12)"), of type w.c ("" for DelayMs).
+//           next() carries on to the next hook, and finally the binding.
+//   make  : optional function(c, n), to stand in for constructing c. It
+//           gives a function(k) returning each method k of the stand-in,
+//           or nothing to construct c as usual
+//
+// Hooks run in list order, the first closest to the script. Each method is
+// wrapped once, whatever the number of hooks. Constructors are replaced
+// once, and they and stand-ins keep the prototype, so instanceof still
+// works.
+//
+// All of it runs ahead of the script on its first line, so line numbers
+// don't move.
+class JSBindingHooks
+{
+public:
+
+    // The script, with the given hooks installed ahead of it, if any
+    static string Instrument(const string &script, const vector<const char *> &hookList)
+    {
+        string retVal = script;
+
+        if (hookList.size())
+        {
+            retVal = HEAD;
+            for (const char *hook : hookList)
+            {
+                retVal += hook;
+            }
+            retVal += TAIL;
+            retVal += script;
+        }
+
+        return retVal;
+    }
+
+
+private:
+
+    // kept to one line, ES5, and out of the way of script globals
+    inline static const char *HEAD =
+        "(function(){Function('return this')().__hk=[];})();";
+
+    inline static const char *TAIL =
+        "(function(){"
+        "var G=Function('return this')(),H=G.__hk;delete G.__hk;"
+        "function L(t){return H.filter(t);}"
+        "function x(h,w,k,f,o){if(!h.length){return f;}return function(){var a=arguments,i=0;function n(){var e=h[i++];return e?e.call(w,k,a,n):f.apply(o,a);}return n();};}"
+        "function W(o,w,h){if(!h.length){return;}var p=Object.getPrototypeOf(o),l=Object.getOwnPropertyNames(o).concat(p&&p!==Object.prototype?Object.getOwnPropertyNames(p):[]),"
+        "s={};l.forEach(function(k){var f;if(s[k]){return;}s[k]=1;try{f=o[k];}catch(e){return;}if(typeof f==='function'&&k!=='constructor'){o[k]=x(h,w,k,f,o);}});}"
+        "['msg','gps','sat','sys','store','math'].forEach(function(n){if(G[n]){W(G[n],{c:n,n:n},L(function(h){return h.o&&h.o.indexOf(n)>=0;}));}});"
+        "function S(C,f){var p=C.prototype,o=Object.create(p||Object.prototype);(p?Object.getOwnPropertyNames(p):[]).forEach(function(k){if(k!=='constructor'){o[k]=f(k);}});"
+        "return typeof Proxy==='function'?new Proxy(o,{get:function(t,k){return k in t?t[k]:f(k);}}):o;}"
+        "var HC=L(function(h){return h.C;}),HM=L(function(h){return h.make;});"
+        "['I2C','Pin','ADC','BH1750','BME280','BMP280','DS18X','MMC56x3','SI7021'].forEach(function(c){var C=G[c];if(typeof C!=='function'||!HC.length&&!HM.length){return;}"
+        "G[c]=function(){var a=Array.prototype.slice.call(arguments),n=c+'('+a.join(',')+')',o,f;for(var i=0;i<HM.length&&!f;++i){f=HM[i].make(c,n);}"
+        "o=f?S(C,f):new(Function.prototype.bind.apply(C,[null].concat(a)))();W(o,{c:c,n:n},HC);return o;};G[c].prototype=C.prototype;});"
+        "var D=G.DelayMs,HD=L(function(h){return h.D;});if(typeof D==='function'){G.DelayMs=x(HD,{c:'',n:''},'DelayMs',D,G);}"
+        "})();";
+};
@@ -0,0 +1,236 @@
+#pragma once
+
+#include "JerryScriptExt.h"
+#include "JerryScriptIntegration.h"
+#include "Log.h"
+#include "Timeline.h"
+#include "Utl.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+using namespace std;
+
+
+// A sampling profile of a script run, by source line and by native call.
+//
+// Native calls: a JSBindingHooks hook times calls on the binding objects
+// and constructed objects, keyed like "BME280.GetTemperatureCelsius".
+//
+// Lines: the VM calls back at every function call and loop iteration. At
+// most once per sample interval, the time since the last sample, less the
+// time spent in native calls since then, is put against the line running
+// now. So lines show script time only, as a statistical estimate, and time
+// in native calls shows only by native call, not on whichever line happens
+// to be sampled after it.
+//
+// The VM has a single callback, which the run's own time limit uses. So a
+// profiled run (only ever asked for by hand) gives it over to the profiler,
+// which its hook installs once the script is running, and which applies
+// the same time limit itself. The VM is torn down after the run, so the
+// callback goes with it. Runs which aren't profiled are left alone.
+class JSCpuProfile
+{
+public:
+
+    struct Entry
+    {
+        uint32_t us    = 0;
+        uint32_t count = 0;     // samples for lines, calls for natives
+    };
+
+    // Call in the running VM, before the script runs
+    void Start(uint64_t timeLimitMs)
+    {
+        lineMap_.clear();
+        nativeMap_.clear();
+
+        timeLimitUs_ = timeLimitMs * 1'000;
+        timeStartUs_ = PAL.Micros();
+        timeLastUs_  = timeStartUs_;
+        nativeUs_    = 0;
+
+        JerryScript::UseThenFreeNewObj([&](auto obj){
+            JerryScript::SetGlobalPropertyNoFree("__prof", obj);
+
+            JerryScript::SetPropertyToNativeFunction(obj, "NowUs", []{
+                return (double)PAL.Micros();
+            });
+
+            // time in native calls, to be kept off the lines
+            JerryScriptExt::SetPropertyToNativeFunction(obj, "AddNativeUs", [this](const jerry_value_t argList[], jerry_length_t argCount){
+                if (argCount >= 1 && jerry_value_is_number(argList[0]))
+                {
+                    nativeUs_ += (uint64_t)jerry_value_as_number(argList[0]);
+                }
+
+                return jerry_undefined();
+            });
+
+            // called by the hook, see above
+            JerryScript::SetPropertyToNativeFunction(obj, "Arm", [this]{
+                jerry_halt_handler(1, OnVmHalt, this);
+                return 0.0;
+            });
+        });
+    }
+
+
+private:
+
+    static jerry_value_t OnVmHalt(void *userData)
+    {
+        JSCpuProfile *self = (JSCpuProfile *)userData;
+
+        if (PAL.Micros() - self->timeStartUs_ > self->timeLimitUs_)
+        {
+            return jerry_throw_sz(JERRY_ERROR_COMMON, "Script time limit exceeded");
+        }
+
+        self->Sample();
+
+        return jerry_undefined();
+    }
+
+    void Sample()
+    {
+        uint64_t timeNowUs = PAL.Micros();
+
+        if (timeNowUs - timeLastUs_ >= SAMPLE_INTERVAL_US)
+        {
+            uint64_t elapsedUs = timeNowUs - timeLastUs_;
+            uint64_t scriptUs  = elapsedUs > nativeUs_ ? elapsedUs - nativeUs_ : 0;
+
+            Entry &e = lineMap_[JerryScriptExt::GetCurrentLine()];
+            e.us += (uint32_t)scriptUs;
+            ++e.count;
+
+            timeLastUs_ = timeNowUs;
+            nativeUs_   = 0;
+        }
+    }
+
+
+public:
+
+    // Call in the running VM, after the script runs
+    void Stop()
+    {
+        jerry_value_t prof = JerryScriptExt::GetGlobalProperty("__prof");
+        jerry_value_t nat  = jerry_object_get_sz(prof, "nat");
+
+        if (jerry_value_is_object(nat))
+        {
+            JerryScriptExt::ForEachProperty(nat, [&](const string &name, jerry_value_t val){
+                Entry &e = nativeMap_[name];
+                e.us    = (uint32_t)JerryScriptExt::GetPropertyNumber(val, "us");
+                e.count = (uint32_t)JerryScriptExt::GetPropertyNumber(val, "calls");
+            });
+        }
+
+        jerry_value_free(nat);
+        jerry_value_free(prof);
+
+        timeTotalUs_ = (uint32_t)(PAL.Micros() - timeStartUs_);
+    }
+
+    // The native call timing hook, for JSBindingHooks
+    static const char *GetHook()
+    {
+        return HOOK;
+    }
+
+    template <typename T>
+    void ToJson(T out) const
+    {
+        for (const auto &[line, e] : lineMap_)
+        {
+            out["lineUs"][to_string(line)] = e.us;
+        }
+        for (const auto &[name, e] : nativeMap_)
+        {
+            out["nativeUs"][name] = e.us;
+            out["nativeCalls"][name] = e.count;
+        }
+        out["totalUs"] = timeTotalUs_;
+    }
+
+    // Flat report, most expensive first, with the source line text
+    string ToString(const string &script, uint8_t countMax = 15) const
+    {
+        string retVal;
+
+        vector<string> srcLineList = Split(script, "\n", false, true);
+
+        auto Pct = [&](uint32_t us){
+            return to_string(timeTotalUs_ ? (uint32_t)((uint64_t)us * 100 / timeTotalUs_) : 0);
+        };
+
+        retVal += "Total " + Commas(timeTotalUs_) + " us\n";
+
+        retVal += "By line:\n";
+        for (const auto &[line, e] : GetSorted(lineMap_, countMax))
+        {
+            string src = line >= 1 && line <= srcLineList.size() ? srcLineList[line - 1] : "";
+            if (src.size() > SRC_LEN_MAX)
+            {
+                src = src.substr(0, SRC_LEN_MAX) + "...";
+            }
+
+            retVal += "  " + StrUtl::PadLeft(Pct(e.us), ' ', 3) + "% " + StrUtl::PadLeft(Commas(e.us), ' ', 9) + " us  line " + StrUtl::PadRight(to_string(line), ' ', 4) + " " + src + "\n";
+        }
+
+        retVal += "By native call:\n";
+        for (const auto &[name, e] : GetSorted(nativeMap_, countMax))
+        {
+            retVal += "  " + StrUtl::PadLeft(Pct(e.us), ' ', 3) + "% " + StrUtl::PadLeft(Commas(e.us), ' ', 9) + " us  " + name + " x" + to_string(e.count) + "\n";
+        }
+
+        return retVal;
+    }
+
+
+private:
+
+    template <typename K>
+    static vector<pair<K, Entry>> GetSorted(const map<K, Entry> &entryMap, uint8_t countMax)
+    {
+        vector<pair<K, Entry>> retVal(entryMap.begin(), entryMap.end());
+
+        sort(retVal.begin(), retVal.end(), [](const auto &a, const auto &b){
+            return a.second.us > b.second.us;
+        });
+
+        if (retVal.size() > countMax)
+        {
+            retVal.resize(countMax);
+        }
+
+        return retVal;
+    }
+
+
+private:
+
+    static const uint32_t SAMPLE_INTERVAL_US = 1'000;
+    static const uint8_t  SRC_LEN_MAX        = 40;
+
+    // kept to one line, ES5, and out of the way of script globals
+    inline static const char *HOOK =
+        "(function(){"
+        "var G=Function('return this')(),P=G.__prof,T=P.nat={};P.Arm();"
+        "G.__hk.push({o:['msg','gps','sys','sat','math'],C:1,D:1,"
+        "call:function(w,k,a,n){var s=P.NowUs();try{return n();}finally{var i=w.c===''?k:w.c+'.'+k,e=T[i]||(T[i]={us:0,calls:0}),d=P.NowUs()-s;e.us+=d;++e.calls;P.AddNativeUs(d);}}});"
+        "})();";
+
+    map<uint32_t, Entry> lineMap_;
+    map<string, Entry>   nativeMap_;
+
+    uint64_t timeLimitUs_ = 0;
+    uint64_t timeStartUs_ = 0;
+    uint64_t timeLastUs_  = 0;
+    uint64_t nativeUs_    = 0;
+    uint32_t timeTotalUs_ = 0;
+};
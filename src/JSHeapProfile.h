@@ -0,0 +1,217 @@
+#pragma once
+
+#include "Log.h"
+#include "Timeline.h"
+#include "Utl.h"
+
+#include "jerryscript.h"
+
+#include <array>
+#include <cstdint>
+#include <string>
+using namespace std;
+
+
+// A breakdown of what is on the JavaScript heap after a script has run.
+//
+// The VM doesn't track allocation sites, so the picture is built from
+// what is alive when the script finishes:
+// - every live object, counted by type
+// - the strings and numbers held by the globals (and what they hold, a
+//   few levels deep), which is where a script's state lives
+//
+// A forced full garbage collection then shows how much of the heap was
+// garbage, and how long collecting it takes.
+//
+// Must be captured while the VM which ran the script is still up.
+class JSHeapProfile
+{
+public:
+
+    enum class ObjType : uint8_t
+    {
+        OBJECT,
+        ARRAY,
+        FUNCTION,
+        ERROR,
+        OTHER,
+        COUNT,
+    };
+
+    static const uint8_t OBJ_TYPE_COUNT = (uint8_t)ObjType::COUNT;
+
+    uint32_t heapCapacity   = 0;
+    uint32_t heapUsed       = 0;    // at end of run
+    uint32_t heapPeak       = 0;
+    uint32_t heapGarbage    = 0;    // freed by a full collection
+    uint32_t gcUs           = 0;
+
+    array<uint16_t, OBJ_TYPE_COUNT> objCountList = {};
+
+    uint16_t stringCount    = 0;
+    uint32_t stringBytes    = 0;
+    uint16_t numberCount    = 0;
+
+
+public:
+
+    void Capture()
+    {
+        *this = {};
+
+        jerry_heap_stats_t stats = {};
+        if (jerry_heap_stats(&stats))
+        {
+            heapCapacity = (uint32_t)stats.size;
+            heapUsed     = (uint32_t)stats.allocated_bytes;
+            heapPeak     = (uint32_t)stats.peak_allocated_bytes;
+        }
+
+        jerry_foreach_live_object([](const jerry_value_t obj, void *userData){
+            JSHeapProfile *self = (JSHeapProfile *)userData;
+
+            ++self->objCountList[(uint8_t)GetObjType(obj)];
+
+            return true;
+        }, this);
+
+        jerry_value_t global = jerry_current_realm();
+        WalkValues(global, 0);
+        jerry_value_free(global);
+
+        // see what a full collection frees and how long it takes
+        uint64_t timeStart = PAL.Micros();
+        jerry_heap_gc(JERRY_GC_PRESSURE_HIGH);
+        gcUs = (uint32_t)(PAL.Micros() - timeStart);
+
+        if (jerry_heap_stats(&stats) && stats.allocated_bytes <= heapUsed)
+        {
+            heapGarbage = heapUsed - (uint32_t)stats.allocated_bytes;
+        }
+    }
+
+    // Remove what is there regardless of the script (the VM and bindings)
+    void SubtractBaseline(const JSHeapProfile &baseline)
+    {
+        auto Sub = [](auto &val, auto base){
+            val = val > base ? val - base : 0;
+        };
+
+        Sub(heapUsed, baseline.heapUsed);
+        Sub(heapPeak, baseline.heapPeak);
+        for (uint8_t i = 0; i < OBJ_TYPE_COUNT; ++i)
+        {
+            Sub(objCountList[i], baseline.objCountList[i]);
+        }
+        Sub(stringCount, baseline.stringCount);
+        Sub(stringBytes, baseline.stringBytes);
+        Sub(numberCount, baseline.numberCount);
+    }
+
+    static const char *GetObjTypeName(ObjType type)
+    {
+        const char *retVal = "";
+
+        switch (type)
+        {
+            case ObjType::OBJECT:   retVal = "object";   break;
+            case ObjType::ARRAY:    retVal = "array";    break;
+            case ObjType::FUNCTION: retVal = "function"; break;
+            case ObjType::ERROR:    retVal = "error";    break;
+            case ObjType::OTHER:    retVal = "other";    break;
+            default: break;
+        }
+
+        return retVal;
+    }
+
+    // out is a json object reference, eg out["heap"]
+    template <typename T>
+    void ToJson(T out) const
+    {
+        out["heapCapacity"] = heapCapacity;
+        out["heapUsed"]     = heapUsed;
+        out["heapPeak"]     = heapPeak;
+        out["heapGarbage"]  = heapGarbage;
+        out["gcUs"]         = gcUs;
+        for (uint8_t i = 0; i < OBJ_TYPE_COUNT; ++i)
+        {
+            out["objCount"][GetObjTypeName((ObjType)i)] = objCountList[i];
+        }
+        out["stringCount"]  = stringCount;
+        out["stringBytes"]  = stringBytes;
+        out["numberCount"]  = numberCount;
+    }
+
+    void Print() const
+    {
+        Log("Heap: ", Commas(heapUsed), " used, ", Commas(heapPeak), " peak, ", Commas(heapCapacity), " capacity");
+        Log("- garbage ", Commas(heapGarbage), " bytes, full gc ", Commas(gcUs), " us");
+        LogNNL("- objects:");
+        for (uint8_t i = 0; i < OBJ_TYPE_COUNT; ++i)
+        {
+            LogNNL(" ", GetObjTypeName((ObjType)i), " ", objCountList[i]);
+        }
+        LogNL();
+        Log("- strings ", stringCount, " (", Commas(stringBytes), " bytes), numbers ", numberCount);
+    }
+
+
+private:
+
+    static ObjType GetObjType(jerry_value_t obj)
+    {
+        ObjType retVal = ObjType::OTHER;
+
+        switch (jerry_object_type(obj))
+        {
+            case JERRY_OBJECT_TYPE_GENERIC:  retVal = ObjType::OBJECT;   break;
+            case JERRY_OBJECT_TYPE_ARRAY:    retVal = ObjType::ARRAY;    break;
+            case JERRY_OBJECT_TYPE_FUNCTION: retVal = ObjType::FUNCTION; break;
+            case JERRY_OBJECT_TYPE_ERROR:    retVal = ObjType::ERROR;    break;
+            default: break;
+        }
+
+        return retVal;
+    }
+
+    void WalkValues(jerry_value_t obj, uint8_t depth)
+    {
+        jerry_value_t keyList = jerry_object_keys(obj);
+
+        if (jerry_value_is_exception(keyList) == false)
+        {
+            uint32_t len = jerry_array_length(keyList);
+
+            for (uint32_t i = 0; i < len; ++i)
+            {
+                jerry_value_t key = jerry_object_get_index(keyList, i);
+                jerry_value_t val = jerry_object_get(obj, key);
+
+                if (jerry_value_is_string(val))
+                {
+                    ++stringCount;
+                    stringBytes += jerry_string_size(val, JERRY_ENCODING_UTF8);
+                }
+                else if (jerry_value_is_number(val))
+                {
+                    ++numberCount;
+                }
+                else if (jerry_value_is_object(val) && jerry_value_is_function(val) == false && depth < WALK_DEPTH_MAX)
+                {
+                    WalkValues(val, depth + 1);
+                }
+
+                jerry_value_free(val);
+                jerry_value_free(key);
+            }
+        }
+
+        jerry_value_free(keyList);
+    }
+
+
+private:
+
+    static const uint8_t WALK_DEPTH_MAX = 3;
+};
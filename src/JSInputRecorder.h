@@ -0,0 +1,401 @@
+#pragma once
+
+#include "FilesystemLittleFS.h"
+#include "JerryScriptExt.h"
+#include "JerryScriptIntegration.h"
+#include "Log.h"
+#include "Utl.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+
+// Records what the bindings gave a slot script during a flight run, so the
+// run can be replayed later, exactly, with the same or another script.
+//
+// Recorded are the results of every call on gps, sat, sys and store, and
+// on the I2C, Pin, ADC and sensor objects, in order, keyed like
+// "gps.GetAltitudeMeters()" or "DS18X(12).GetTemperatureCelsius()".
+//
+// On replay, those calls are answered from the recording instead, in the
+// same order per key, without touching hardware, and DelayMs returns at
+// once. A call the recording has no answer for returns undefined and is
+// counted as a miss.
+//
+// The JS side is a JSBindingHooks hook. It goes first in the hook order,
+// closest to the script, so what is recorded is what the script saw (eg
+// values from the sensor cache too).
+//
+// Recordings are kept in RAM and written to flash by Flush() (once a
+// window). Each run is one line, eg
+//   "slot1 1a2b3c4d\tgps.GetAltitudeMeters()=n12060\tsys.GetInputVoltageVolts()=n3.3"
+// Values are n<number>, b0 / b1, s<string>, or u for anything else.
+// The file rolls over to a second one when it gets big, so the two hold
+// the latest runs. Recording is off unless turned on.
+class JSInputRecorder
+{
+private:
+
+    inline static const char *FILE_NAME     = "jsrec.txt";
+    inline static const char *FILE_NAME_OLD = "jsrec.old.txt";
+    inline static const char *FILE_VERSION  = "v1";
+
+public:
+
+    static const uint16_t VALUE_COUNT_MAX = 128;
+    static const uint16_t FILE_SIZE_MAX   = 8 * 1'024;
+
+    struct Recording
+    {
+        string   slotName;
+        uint32_t scriptHash = 0;
+
+        vector<pair<string, string>> kvList;
+    };
+
+
+public:
+
+    void Load()
+    {
+        enabled_ = false;
+
+        vector<string> lineList = Split(FilesystemLittleFS::Read(FILE_NAME), "\n");
+
+        if (lineList.size() >= 1 && lineList[0] == string{FILE_VERSION} + " record=1")
+        {
+            enabled_ = true;
+        }
+    }
+
+    void SetEnabled(bool enabled)
+    {
+        enabled_ = enabled;
+
+        // keep the file's header, and so the setting, up to date
+        Flush(true);
+    }
+
+    bool GetEnabled() const
+    {
+        return enabled_;
+    }
+
+    void Clear()
+    {
+        pendingList_.clear();
+
+        FilesystemLittleFS::Remove(FILE_NAME_OLD);
+        Flush(true);
+    }
+
+    // Write runs recorded since last time to flash
+    bool Flush(bool force = false)
+    {
+        bool retVal = true;
+
+        if (pendingList_.size() || force)
+        {
+            string data = ReadRunLines(FILE_NAME);
+            for (const auto &line : pendingList_)
+            {
+                data += line + "\n";
+            }
+            pendingList_.clear();
+
+            // roll over when big
+            if (data.size() > FILE_SIZE_MAX)
+            {
+                FilesystemLittleFS::Write(FILE_NAME_OLD, GetHeader() + data);
+                data = "";
+            }
+
+            retVal = FilesystemLittleFS::Write(FILE_NAME, GetHeader() + data);
+
+            if (retVal == false)
+            {
+                Log("ERR: JS recording: could not save");
+            }
+        }
+
+        return retVal;
+    }
+
+    // All recorded runs as text, oldest first
+    string GetRecordingText() const
+    {
+        string retVal = ReadRunLines(FILE_NAME_OLD) + ReadRunLines(FILE_NAME);
+
+        for (const auto &line : pendingList_)
+        {
+            retVal += line + "\n";
+        }
+
+        return retVal;
+    }
+
+    // idx 0 is the latest run
+    bool GetRecording(uint16_t idx, Recording &rec) const
+    {
+        vector<string> lineList = Split(GetRecordingText(), "\n");
+
+        bool retVal = idx < lineList.size();
+
+        if (retVal)
+        {
+            retVal = FromLine(lineList[lineList.size() - 1 - idx], rec);
+        }
+
+        return retVal;
+    }
+
+    // One run, as recorded, or sent by a host
+    static bool FromLine(const string &line, Recording &rec)
+    {
+        rec = {};
+
+        vector<string> partList = Split(line, "\t", false, true);
+        vector<string> hdrList  = Split(partList[0], " ");
+
+        bool retVal = hdrList.size() == 2;
+
+        if (retVal)
+        {
+            rec.slotName   = hdrList[0];
+            rec.scriptHash = (uint32_t)strtoul(hdrList[1].c_str(), nullptr, 16);
+
+            for (size_t i = 1; i < partList.size(); ++i)
+            {
+                // keys can't hold '=', values can
+                size_t pos = partList[i].find('=');
+
+                if (pos != string::npos)
+                {
+                    rec.kvList.push_back({ partList[i].substr(0, pos), partList[i].substr(pos + 1) });
+                }
+            }
+        }
+
+        return retVal;
+    }
+
+    static uint32_t Hash(const string &script)
+    {
+        // FNV-1a, stable across builds so recordings stay comparable
+        uint32_t retVal = 2'166'136'261u;
+
+        for (char c : script)
+        {
+            retVal = (retVal ^ (uint8_t)c) * 16'777'619u;
+        }
+
+        return retVal;
+    }
+
+    // Call in the running VM, before the script runs.
+    // With replay, calls are answered from it rather than recorded.
+    void Start(const string &slotName, const string &script, const Recording *replay = nullptr)
+    {
+        rec_ = {};
+        rec_.slotName   = slotName;
+        rec_.scriptHash = Hash(script);
+
+        replayMap_.clear();
+        missCount_ = 0;
+        replaying_ = replay != nullptr;
+
+        if (replaying_)
+        {
+            for (const auto &[key, val] : replay->kvList)
+            {
+                replayMap_[key].push_back(val);
+            }
+        }
+
+        JerryScript::UseThenFreeNewObj([&](auto obj){
+            JerryScript::SetGlobalPropertyNoFree("__rec", obj);
+
+            JerryScript::SetPropertyToNativeFunction(obj, "Play", [this]{
+                return (double)replaying_;
+            });
+
+            JerryScriptExt::SetPropertyToNativeFunction(obj, "Put", [this](const jerry_value_t argList[], jerry_length_t argCount){
+                string key = JerryScriptExt::GetArgString(argList, argCount, 0);
+
+                if (rec_.kvList.size() < VALUE_COUNT_MAX && key.find_first_of("\t\n=") == string::npos)
+                {
+                    rec_.kvList.push_back({ key, argCount >= 2 ? ToValue(argList[1]) : "u" });
+                }
+
+                return jerry_undefined();
+            });
+
+            JerryScriptExt::SetPropertyToNativeFunction(obj, "Take", [this](const jerry_value_t argList[], jerry_length_t argCount){
+                jerry_value_t retVal = jerry_undefined();
+
+                auto it = replayMap_.find(JerryScriptExt::GetArgString(argList, argCount, 0));
+
+                if (it != replayMap_.end() && it->second.size())
+                {
+                    retVal = FromValue(it->second.front());
+                    it->second.pop_front();
+                }
+                else
+                {
+                    ++missCount_;
+                }
+
+                return retVal;
+            });
+        });
+    }
+
+    // Call after the run, keeps what was recorded, if asked to
+    void EndRun(bool keep = true)
+    {
+        if (keep && replaying_ == false)
+        {
+            pendingList_.push_back(ToLine(rec_));
+        }
+    }
+
+    uint16_t GetMissCount() const
+    {
+        return missCount_;
+    }
+
+    // The recording hook, for JSBindingHooks
+    static const char *GetHook()
+    {
+        return HOOK;
+    }
+
+    void Print() const
+    {
+        vector<string> lineList = Split(GetRecordingText(), "\n");
+
+        Log("JS recording: ", enabled_ ? "on" : "off", ", ", lineList.size(), " runs (", pendingList_.size(), " not saved)");
+        for (size_t i = 0; i < lineList.size(); ++i)
+        {
+            Recording rec;
+            if (FromLine(lineList[i], rec))
+            {
+                Log("- ", lineList.size() - 1 - i, ": ", rec.slotName, " script ", ToHex(rec.scriptHash), ", ", rec.kvList.size(), " values");
+            }
+        }
+    }
+
+
+private:
+
+    string GetHeader() const
+    {
+        return string{FILE_VERSION} + (enabled_ ? " record=1" : " record=0") + "\n";
+    }
+
+    // the file less its header
+    static string ReadRunLines(const char *fileName)
+    {
+        string retVal = FilesystemLittleFS::Read(fileName);
+
+        size_t pos = retVal.find('\n');
+        retVal = pos == string::npos ? "" : retVal.substr(pos + 1);
+
+        return retVal;
+    }
+
+    static string ToHex(uint32_t val)
+    {
+        char buf[9];
+        snprintf(buf, sizeof(buf), "%08lx", (unsigned long)val);
+
+        return buf;
+    }
+
+    static string ToLine(const Recording &rec)
+    {
+        string retVal = rec.slotName + " " + ToHex(rec.scriptHash);
+
+        for (const auto &[key, val] : rec.kvList)
+        {
+            retVal += "\t" + key + "=" + val;
+        }
+
+        return retVal;
+    }
+
+    // numbers to full precision, so replays are exact
+    static string ToValue(jerry_value_t val)
+    {
+        string retVal = "u";
+
+        if (jerry_value_is_number(val))
+        {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "n%.17g", jerry_value_as_number(val));
+
+            retVal = buf;
+        }
+        else if (jerry_value_is_boolean(val))
+        {
+            retVal = jerry_value_is_true(val) ? "b1" : "b0";
+        }
+        else if (jerry_value_is_string(val))
+        {
+            string str = JerryScriptExt::ToString(val);
+
+            if (str.find_first_of("\t\n") == string::npos)
+            {
+                retVal = "s" + str;
+            }
+        }
+
+        return retVal;
+    }
+
+    static jerry_value_t FromValue(const string &val)
+    {
+        jerry_value_t retVal = jerry_undefined();
+
+        if (val.size() >= 2 && val[0] == 'n')
+        {
+            retVal = jerry_number(strtod(val.c_str() + 1, nullptr));
+        }
+        else if (val.size() == 2 && val[0] == 'b')
+        {
+            retVal = jerry_boolean(val[1] == '1');
+        }
+        else if (val.size() >= 1 && val[0] == 's')
+        {
+            retVal = jerry_string_sz(val.c_str() + 1);
+        }
+
+        return retVal;
+    }
+
+
+private:
+
+    // kept to one line, ES5, and out of the way of script globals
+    inline static const char *HOOK =
+        "(function(){"
+        "var G=Function('return this')(),R=G.__rec,P=R.Play();"
+        "G.__hk.push({o:['gps','sat','sys','store'],C:1,D:P,"
+        "call:function(w,k,a,n){if(w.c===''){return;}var e=w.n+'.'+k+'('+Array.prototype.join.call(a,',')+')';if(P){return R.Take(e);}var v=n();R.Put(e,v);return v;},"
+        "make:P?function(c,n){return function(k){return function(){return R.Take(n+'.'+k+'('+Array.prototype.join.call(arguments,',')+')');};};}:null});"
+        "})();";
+
+    bool enabled_ = false;
+
+    Recording      rec_;
+    vector<string> pendingList_;
+
+    bool                        replaying_ = false;
+    map<string, deque<string>>  replayMap_;
+    uint16_t                    missCount_ = 0;
+};
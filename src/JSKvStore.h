@@ -0,0 +1,251 @@
+#pragma once
+
+#include "FilesystemLittleFS.h"
+#include "JerryScriptExt.h"
+#include "JerryScriptIntegration.h"
+#include "Log.h"
+#include "Utl.h"
+
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+
+// A small key/value store for scripts to keep state across runs, eg
+// running min/max, averages, counters, or the last value sent for delta
+// encoding. Each run gets a fresh VM, so without it that state is lost.
+//
+// Exposed to scripts as:
+//   store.Get(key [, default])   number or string, default (or undefined) if not set
+//   store.Set(key, value)        number or string, false if it doesn't fit
+//   store.Delete(key)
+//
+// Writes are made to a scratch copy during a run, and only kept if the run
+// is a slot script run which succeeds. Prefetch, test and failed runs leave
+// the store as it was.
+//
+// Optionally persisted to flash. Writes are coalesced, the file is only
+// written by Flush() (once a window), and only when something changed.
+//
+// Stored as text, a version and options line, then one tab separated
+// "key type value" line per entry, eg "v1 persist=1\nmaxAlt\tn\t12345".
+class JSKvStore
+{
+private:
+
+    inline static const char *FILE_NAME    = "jsstore.txt";
+    inline static const char *FILE_VERSION = "v1";
+
+public:
+
+    static const uint8_t ENTRY_COUNT_MAX = 32;
+    static const uint8_t KEY_LEN_MAX     = 32;
+    static const uint8_t STR_LEN_MAX     = 64;
+
+    struct Value
+    {
+        bool   isNumber = true;
+        double num      = 0;
+        string str;
+
+        bool operator==(const Value &) const = default;
+    };
+
+
+public:
+
+    void Load()
+    {
+        kvMap_.clear();
+        persist_ = false;
+        dirty_   = false;
+
+        vector<string> lineList = Split(FilesystemLittleFS::Read(FILE_NAME), "\n");
+
+        if (lineList.size() >= 1 && lineList[0] == string{FILE_VERSION} + " persist=1")
+        {
+            persist_ = true;
+
+            for (size_t i = 1; i < lineList.size(); ++i)
+            {
+                vector<string> partList = Split(lineList[i], "\t", false, true);
+
+                if (partList.size() == 3 && kvMap_.size() < ENTRY_COUNT_MAX)
+                {
+                    Value val;
+                    val.isNumber = partList[1] == "n";
+                    val.num      = val.isNumber ? atof(partList[2].c_str()) : 0;
+                    val.str      = val.isNumber ? "" : partList[2];
+
+                    kvMap_[partList[0]] = val;
+                }
+            }
+        }
+    }
+
+    // Write to flash if persisting and anything changed since last time
+    bool Flush()
+    {
+        bool retVal = true;
+
+        if (persist_ && dirty_)
+        {
+            retVal = Save();
+        }
+
+        return retVal;
+    }
+
+    void SetPersist(bool persist)
+    {
+        persist_ = persist;
+
+        if (persist_)
+        {
+            Save();
+        }
+        else
+        {
+            FilesystemLittleFS::Remove(FILE_NAME);
+        }
+    }
+
+    bool GetPersist() const
+    {
+        return persist_;
+    }
+
+    void Clear()
+    {
+        kvMap_.clear();
+        dirty_ = true;
+    }
+
+    const map<string, Value> &GetKvMap() const
+    {
+        return kvMap_;
+    }
+
+    // Call in the running VM, before the script runs
+    void Register()
+    {
+        scratchMap_ = kvMap_;
+
+        JerryScript::UseThenFreeNewObj([&](auto obj){
+            JerryScript::SetGlobalPropertyNoFree("store", obj);
+
+            JerryScriptExt::SetPropertyToNativeFunction(obj, "Get", [this](const jerry_value_t argList[], jerry_length_t argCount){
+                jerry_value_t retVal = argCount >= 2 ? jerry_value_copy(argList[1]) : jerry_undefined();
+
+                auto it = scratchMap_.find(JerryScriptExt::GetArgString(argList, argCount, 0));
+
+                if (it != scratchMap_.end())
+                {
+                    jerry_value_free(retVal);
+
+                    retVal = it->second.isNumber ? jerry_number(it->second.num) : jerry_string_sz(it->second.str.c_str());
+                }
+
+                return retVal;
+            });
+
+            JerryScriptExt::SetPropertyToNativeFunction(obj, "Set", [this](const jerry_value_t argList[], jerry_length_t argCount){
+                bool retVal = false;
+
+                if (argCount >= 2)
+                {
+                    Value val;
+                    val.isNumber = jerry_value_is_number(argList[1]);
+                    val.num      = val.isNumber ? jerry_value_as_number(argList[1]) : 0;
+                    val.str      = val.isNumber ? "" : JerryScriptExt::ToString(argList[1]);
+
+                    retVal = Set(JerryScriptExt::GetArgString(argList, argCount, 0), val);
+                }
+
+                return jerry_boolean(retVal);
+            });
+
+            JerryScriptExt::SetPropertyToNativeFunction(obj, "Delete", [this](const jerry_value_t argList[], jerry_length_t argCount){
+                scratchMap_.erase(JerryScriptExt::GetArgString(argList, argCount, 0));
+
+                return jerry_undefined();
+            });
+        });
+    }
+
+    // Call after the run, keep selects whether the run's writes are kept
+    void EndRun(bool keep)
+    {
+        if (keep && scratchMap_ != kvMap_)
+        {
+            kvMap_ = scratchMap_;
+            dirty_ = true;
+        }
+
+        scratchMap_.clear();
+    }
+
+    void Print() const
+    {
+        Log("JS store: ", kvMap_.size(), " / ", ENTRY_COUNT_MAX, " entries, ", persist_ ? "persisted" : "RAM only", dirty_ ? ", unsaved changes" : "");
+        for (const auto &[key, val] : kvMap_)
+        {
+            Log("- ", StrUtl::PadRight(key, ' ', KEY_LEN_MAX), " ", val.isNumber ? ToString(val.num, 3) : "\"" + val.str + "\"");
+        }
+    }
+
+
+private:
+
+    bool Set(const string &key, const Value &val)
+    {
+        bool retVal = false;
+
+        auto Ok = [](const string &str, uint8_t lenMax){
+            return str.size() <= lenMax && str.find_first_of("\t\n") == string::npos;
+        };
+
+        if (key != "" && Ok(key, KEY_LEN_MAX) && Ok(val.str, STR_LEN_MAX) &&
+            (scratchMap_.contains(key) || scratchMap_.size() < ENTRY_COUNT_MAX))
+        {
+            scratchMap_[key] = val;
+
+            retVal = true;
+        }
+
+        return retVal;
+    }
+
+    bool Save()
+    {
+        string data = string{FILE_VERSION} + " persist=1";
+        for (const auto &[key, val] : kvMap_)
+        {
+            data += "\n" + key + "\t" + (val.isNumber ? "n\t" + ToString(val.num, 6) : "s\t" + val.str);
+        }
+
+        bool retVal = FilesystemLittleFS::Write(FILE_NAME, data);
+
+        if (retVal)
+        {
+            dirty_ = false;
+        }
+        else
+        {
+            Log("ERR: JS store: could not save");
+        }
+
+        return retVal;
+    }
+
+
+private:
+
+    map<string, Value> kvMap_;
+    map<string, Value> scratchMap_;
+
+    bool persist_ = false;
+    bool dirty_   = false;
+};
@@ -0,0 +1,226 @@
+#pragma once
+
+#include "JerryScriptExt.h"
+#include "JerryScriptIntegration.h"
+#include "Log.h"
+#include "Timeline.h"
+#include "Utl.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+using namespace std;
+
+
+// Telemetry conversions done natively, for scripts, rather than in
+// interpreted soft-float.
+//
+// The RP2040 has no FPU, so the kernels work in integers: a table of the
+// standard atmosphere for altitude, and a Q16 fixed-point log for dew
+// point. Only the conversions in and out of the script's numbers are
+// floating point.
+//
+// Exposed to scripts as:
+//   math.PressureToAltitudeMeters(pa [, seaLevelPa])   to within 6 m, -1,000 to 40,000 m
+//   math.DewPointCelsius(tempC, rhPct)                 Magnus formula, to within 0.02 C
+class JSMath
+{
+public:
+
+    static constexpr double SEA_LEVEL_PA = 101325;
+
+    // assumes the VM is running
+    static void Register()
+    {
+        JerryScript::UseThenFreeNewObj([&](auto obj){
+            JerryScript::SetGlobalPropertyNoFree("math", obj);
+
+            JerryScriptExt::SetPropertyToNativeFunction(obj, "PressureToAltitudeMeters", [](const jerry_value_t argList[], jerry_length_t argCount){
+                double pa         = JerryScriptExt::GetArgNumber(argList, argCount, 0);
+                double seaLevelPa = JerryScriptExt::GetArgNumber(argList, argCount, 1, SEA_LEVEL_PA);
+
+                return jerry_number(PressureToAltitudeMeters(pa, seaLevelPa));
+            });
+
+            JerryScriptExt::SetPropertyToNativeFunction(obj, "DewPointCelsius", [](const jerry_value_t argList[], jerry_length_t argCount){
+                double tempC = JerryScriptExt::GetArgNumber(argList, argCount, 0);
+                double rhPct = JerryScriptExt::GetArgNumber(argList, argCount, 1);
+
+                return jerry_number(DewPointCelsius(tempC, rhPct));
+            });
+        });
+    }
+
+    // Standard atmosphere altitude, with pressure scaled for the given
+    // sea level pressure. Clamped to the table range.
+    static double PressureToAltitudeMeters(double pa, double seaLevelPa = SEA_LEVEL_PA)
+    {
+        int32_t retVal = ALT_TABLE_START_M;
+
+        int64_t seaLevelDpa = llround(seaLevelPa * 10);
+        int64_t dpa         = llround(pa * 10);
+
+        if (seaLevelDpa > 0)
+        {
+            dpa = dpa * (int64_t)(SEA_LEVEL_PA * 10) / seaLevelDpa;
+        }
+
+        if (dpa >= PRESSURE_DPA_TABLE.front())
+        {
+            retVal = ALT_TABLE_START_M;
+        }
+        else if (dpa <= PRESSURE_DPA_TABLE.back())
+        {
+            retVal = ALT_TABLE_START_M + (int32_t)(PRESSURE_DPA_TABLE.size() - 1) * ALT_TABLE_STEP_M;
+        }
+        else
+        {
+            // find the entries either side, pressure falls as the index rises
+            size_t lo = 0;
+            size_t hi = PRESSURE_DPA_TABLE.size() - 1;
+            while (hi - lo > 1)
+            {
+                size_t mid = (lo + hi) / 2;
+
+                if (PRESSURE_DPA_TABLE[mid] >= dpa) { lo = mid; }
+                else                                { hi = mid; }
+            }
+
+            int64_t span = PRESSURE_DPA_TABLE[lo] - PRESSURE_DPA_TABLE[hi];
+
+            retVal = ALT_TABLE_START_M + (int32_t)lo * ALT_TABLE_STEP_M + (int32_t)((PRESSURE_DPA_TABLE[lo] - dpa) * ALT_TABLE_STEP_M / span);
+        }
+
+        return retVal;
+    }
+
+    // Magnus formula, relative humidity clamped to 0.1 - 100 %
+    static double DewPointCelsius(double tempC, double rhPct)
+    {
+        int64_t tQ16  = llround(tempC * Q16_ONE);
+        int64_t rhQ16 = llround(rhPct * Q16_ONE / 100);
+
+        rhQ16 = clamp<int64_t>(rhQ16, Q16_ONE / 1'000, Q16_ONE);
+
+        // (c + t) has no zero in range, magnus is good to about -45 C anyway
+        int64_t gammaQ16 = LnQ16((uint32_t)rhQ16) + MAGNUS_B_Q16 * tQ16 / (MAGNUS_C_Q16 + tQ16);
+        int64_t tdQ16    = MAGNUS_C_Q16 * gammaQ16 / (MAGNUS_B_Q16 - gammaQ16);
+
+        return (double)tdQ16 / Q16_ONE;
+    }
+
+    // Compare against the floating point formulas, and time both
+    static void Test()
+    {
+        Log("math.PressureToAltitudeMeters");
+        double errMax = 0;
+        for (int32_t altM = -900; altM < 40'000; altM += 7)
+        {
+            errMax = max(errMax, fabs(PressureToAltitudeMeters(RefPressurePa(altM)) - altM));
+        }
+        Log("- max err ", ToString(errMax, 1), " m");
+
+        Log("math.DewPointCelsius");
+        errMax = 0;
+        for (int32_t tempC = -40; tempC <= 50; tempC += 3)
+        {
+            for (int32_t rhPct = 1; rhPct <= 100; ++rhPct)
+            {
+                errMax = max(errMax, fabs(DewPointCelsius(tempC, rhPct) - RefDewPointCelsius(tempC, rhPct)));
+            }
+        }
+        Log("- max err ", ToString(errMax, 4), " C");
+
+        static const uint32_t ITERATIONS = 1'000;
+        volatile double sink = 0;
+        auto Time = [&](const char *name, auto fn){
+            uint64_t timeStart = PAL.Micros();
+            for (uint32_t i = 0; i < ITERATIONS; ++i)
+            {
+                sink = fn(i);
+            }
+            Log("- ", name, ": ", Commas((PAL.Micros() - timeStart) * 1'000 / ITERATIONS), " ns/call");
+        };
+        Log("Timing");
+        Time("altitude, table     ", [](uint32_t i){ return PressureToAltitudeMeters(1'000 + i * 100); });
+        Time("altitude, pow       ", [](uint32_t i){ return 44'330 * (1 - pow((1'000 + i * 100) / SEA_LEVEL_PA, 0.190263)); });
+        Time("dew point, fixed    ", [](uint32_t i){ return DewPointCelsius(20, 1 + i % 100); });
+        Time("dew point, log      ", [](uint32_t i){ return RefDewPointCelsius(20, 1 + i % 100); });
+        (void)sink;
+    }
+
+
+private:
+
+    // ln(x) for x in Q16, result in Q16
+    static int64_t LnQ16(uint32_t xQ16)
+    {
+        int32_t  msb = 31 - __builtin_clz(xQ16);
+        uint32_t m   = msb >= 16 ? xQ16 >> (msb - 16) : xQ16 << (16 - msb);   // [1, 2) in Q16
+
+        uint32_t idx  = (m - Q16_ONE) >> LN_TABLE_SHIFT;
+        uint32_t frac = (m - Q16_ONE) & ((1 << LN_TABLE_SHIFT) - 1);
+
+        int64_t lnM = LN_TABLE_Q16[idx] + (((int64_t)(LN_TABLE_Q16[idx + 1] - LN_TABLE_Q16[idx]) * frac) >> LN_TABLE_SHIFT);
+
+        return (int64_t)(msb - 16) * LN2_Q16 + lnM;
+    }
+
+    static double RefPressurePa(double altM)
+    {
+        double retVal = 0;
+
+        if      (altM <= 11'000) { retVal = 101'325   * pow(1 - 2.25577e-5 * altM, 5.25588);                  }
+        else if (altM <= 20'000) { retVal = 22'632.06 * exp(-0.000157688 * (altM - 11'000));                   }
+        else if (altM <= 32'000) { retVal = 5'474.889 * pow(1 + (altM - 20'000) / 216'650, -34.1632);          }
+        else                     { retVal = 868.0187  * pow(1 + 0.0028 * (altM - 32'000) / 228.65, -12.2011); }
+
+        return retVal;
+    }
+
+    static double RefDewPointCelsius(double tempC, double rhPct)
+    {
+        double gamma = log(rhPct / 100) + 17.62 * tempC / (243.12 + tempC);
+
+        return 243.12 * gamma / (17.62 - gamma);
+    }
+
+
+private:
+
+    inline static const int64_t Q16_ONE = 1 << 16;
+
+    static const int64_t MAGNUS_B_Q16 = 1'154'744;      // 17.62
+    static const int64_t MAGNUS_C_Q16 = 15'933'112;     // 243.12 C
+
+    static const int32_t ALT_TABLE_START_M = -1'000;
+    static const int32_t ALT_TABLE_STEP_M  = 500;
+
+    // standard atmosphere pressure in decipascals, every 500 m from -1,000 m
+    static constexpr array<int32_t, 83> PRESSURE_DPA_TABLE = {
+        1139291, 1074775, 1013250, 954608, 898746, 845560, 794952, 746825,
+        701085, 657641, 616402, 577283, 540199, 505068, 471810, 440348,
+        410607, 382514, 355998, 330990, 307424, 285236, 264362, 244743,
+        226320, 209162, 193304, 178649, 165104, 152587, 141018, 130327,
+        120446, 111314, 102875, 95075, 87867, 81205, 75049, 69359,
+        64100, 59240, 54749, 50603, 46779, 43252, 39998, 36995,
+        34224, 31666, 29305, 27124, 25110, 23250, 21531, 19943,
+        18475, 17118, 15863, 14703, 13630, 12637, 11719, 10869,
+        10082, 9354, 8680, 8057, 7482, 6952, 6461, 6008,
+        5589, 5202, 4843, 4511, 4204, 3919, 3655, 3410,
+        3182, 2971, 2775,
+    };
+
+    // ln(1 + i/32) in Q16
+    static const uint8_t LN_TABLE_SHIFT = 11;
+    static const int64_t LN2_Q16        = 45'426;
+
+    static constexpr array<int32_t, 33> LN_TABLE_Q16 = {
+        0, 2017, 3973, 5873, 7719, 9515, 11262, 12965,
+        14624, 16242, 17821, 19364, 20870, 22343, 23783, 25193,
+        26573, 27924, 29248, 30546, 31818, 33067, 34292, 35494,
+        36675, 37835, 38975, 40095, 41196, 42280, 43345, 44394,
+        45426,
+    };
+};
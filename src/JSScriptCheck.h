@@ -0,0 +1,165 @@
+#pragma once
+
+#include "JerryScriptExt.h"
+#include "JSScriptScan.h"
+#include "Utl.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+using namespace std;
+
+
+// Checks on a script ahead of flight, from a dry run.
+//
+// Mocking: a JSBindingHooks hook stands in for the I2C, Pin, ADC and
+// sensor constructors with objects which don't touch hardware, and makes
+// DelayMs return at once. Getters return a plausible reading for what their name says
+// (eg 20 for a Celsius temperature, 1013 for hectopascals), so a script
+// takes the path it would with a working sensor, not its fallback for a
+// missing one. Other getters return 1, and other methods 0.
+//
+// Fields set: the hook also notes each msg.Set* call, so fields the
+// script never sets can be listed.
+//
+// Unknown APIs: each use of a binding object's property in the script
+// (eg msg.SetAltitudeMeters) is looked for on the object itself, so a
+// misspelled or undefined field or function is found without the script
+// having to reach it.
+class JSScriptCheck
+{
+public:
+
+    // The mocking hook, for JSBindingHooks
+    static const char *GetHook()
+    {
+        return HOOK;
+    }
+
+    // Call in the running VM, with the bindings loaded.
+    // Returns uses like "msg.SetAltitudeMetrs", in order of first use.
+    static vector<string> GetUnknownApiList(const string &script)
+    {
+        vector<string> retVal;
+
+        map<string, set<string>> objPropSetMap;
+        for (const auto &objName : API_OBJ_LIST)
+        {
+            set<string> &propSet = objPropSetMap[objName];
+
+            jerry_value_t obj = JerryScriptExt::GetGlobalProperty(objName);
+            if (jerry_value_is_object(obj))
+            {
+                JerryScriptExt::ForEachProperty(obj, [&](const string &key, jerry_value_t){
+                    propSet.insert(key);
+                });
+            }
+            jerry_value_free(obj);
+        }
+
+        for (const auto &[objName, propName] : GetApiUseList(script))
+        {
+            string use = objName + "." + propName;
+
+            if (objPropSetMap[objName].contains(propName) == false &&
+                find(retVal.begin(), retVal.end(), use) == retVal.end())
+            {
+                retVal.push_back(use);
+            }
+        }
+
+        return retVal;
+    }
+
+
+    // Call in the running VM, after the run.
+    // Those of fieldList the script set, in the same order.
+    static vector<string> GetFieldSetList(const vector<string> &fieldList)
+    {
+        vector<string> retVal;
+
+        set<string> fieldSetSet;
+
+        jerry_value_t chk = JerryScriptExt::GetGlobalProperty("__chk");
+        if (jerry_value_is_object(chk))
+        {
+            JerryScriptExt::ForEachProperty(chk, [&](const string &key, jerry_value_t){
+                fieldSetSet.insert(key);
+            });
+        }
+        jerry_value_free(chk);
+
+        for (const auto &fieldName : fieldList)
+        {
+            if (fieldSetSet.contains(fieldName))
+            {
+                retVal.push_back(fieldName);
+            }
+        }
+
+        return retVal;
+    }
+
+
+private:
+
+    // (object, property) for each "object.property" in the script, outside
+    // of comments and strings, where object is one of the binding objects
+    static vector<pair<string, string>> GetApiUseList(const string &script)
+    {
+        vector<pair<string, string>> retVal;
+
+        string code = JSScriptScan::GetCode(script);
+
+        // by position, so in order of use
+        map<size_t, pair<string, string>> posUseMap;
+
+        for (const auto &objName : API_OBJ_LIST)
+        {
+            string prefix = string{objName} + ".";
+
+            // whole identifiers only, eg not "mymsg." or "x.msg."
+            for (size_t pos = JSScriptScan::FindToken(code, prefix); pos != string::npos; pos = JSScriptScan::FindToken(code, prefix, pos + 1))
+            {
+                size_t start = pos + prefix.size();
+                size_t end   = start;
+                while (end < code.size() && JSScriptScan::IsIdChar(code[end]))
+                {
+                    ++end;
+                }
+
+                if (end > start)
+                {
+                    posUseMap[pos] = { objName, code.substr(start, end - start) };
+                }
+            }
+        }
+
+        for (const auto &[pos, use] : posUseMap)
+        {
+            retVal.push_back(use);
+        }
+
+        return retVal;
+    }
+
+
+private:
+
+    inline static const vector<const char *> API_OBJ_LIST = {
+        "msg", "gps", "sat", "sys", "store", "math",
+    };
+
+    // kept to one line, ES5, and out of the way of script globals
+    inline static const char *HOOK =
+        "(function(){"
+        "var G=Function('return this')(),F=G.__chk={};"
+        "var V=[[/Fahrenheit/,68],[/Celsius|Temp/,20],[/Humidity/,45],[/HectoPascal|Hpa|HPa|Millibar|Mbar/,1013],[/Pascal|Pressure/,101325],[/Lux|Light/,500],[/MilliVolt/,3300],[/Volt/,3.3],[/Altitude|Meters/,100],[/Tesla|Gauss|Magnet/,25]];"
+        "function z(k){return function(){if(typeof k!=='string'||k.indexOf('Get')!==0){return 0;}for(var i=0;i<V.length;++i){if(V[i][0].test(k)){return V[i][1];}}return 1;};}"
+        "G.__hk.push({o:['msg'],D:1,"
+        "call:function(w,k,a,n){if(w.c===''){return;}if(k.indexOf('Set')===0){F[k.substr(3)]=1;}return n();},"
+        "make:function(){return z;}});"
+        "})();";
+};
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cctype>
+#include <string>
+using namespace std;
+
+
+// Looking through script source for uses of the bindings, without being
+// fooled by comments or strings.
+//
+// GetCode() gives the script with the insides of comments and of string
+// literals blanked to spaces. Newlines are kept, so lines and columns
+// still line up with the script. Searches are then done on the result.
+//
+// Regular expression literals aren't recognized, and are searched as code.
+class JSScriptScan
+{
+public:
+
+    static string GetCode(const string &script)
+    {
+        string retVal = script;
+
+        enum class State { CODE, LINE_COMMENT, BLOCK_COMMENT, STRING };
+
+        State state = State::CODE;
+        char  quote = 0;
+
+        for (size_t i = 0; i < retVal.size(); ++i)
+        {
+            char c    = retVal[i];
+            char next = i + 1 < retVal.size() ? retVal[i + 1] : 0;
+
+            if (state == State::CODE)
+            {
+                if (c == '/' && next == '/')
+                {
+                    state = State::LINE_COMMENT;
+                    Blank(retVal, i);
+                }
+                else if (c == '/' && next == '*')
+                {
+                    state = State::BLOCK_COMMENT;
+                    Blank(retVal, i);
+                    Blank(retVal, ++i);
+                }
+                else if (c == '"' || c == '\'' || c == '`')
+                {
+                    state = State::STRING;
+                    quote = c;
+                }
+            }
+            else if (state == State::LINE_COMMENT)
+            {
+                if (c == '\n')
+                {
+                    state = State::CODE;
+                }
+                else
+                {
+                    Blank(retVal, i);
+                }
+            }
+            else if (state == State::BLOCK_COMMENT)
+            {
+                if (c == '*' && next == '/')
+                {
+                    state = State::CODE;
+                    Blank(retVal, i);
+                    Blank(retVal, ++i);
+                }
+                else
+                {
+                    Blank(retVal, i);
+                }
+            }
+            else if (state == State::STRING)
+            {
+                if (c == '\\' && next != 0)
+                {
+                    Blank(retVal, i);
+                    Blank(retVal, ++i);
+                }
+                else if (c == quote)
+                {
+                    state = State::CODE;
+                }
+                else if (c == '\n' && quote != '`')
+                {
+                    // unterminated, let the parser complain about it
+                    state = State::CODE;
+                }
+                else
+                {
+                    Blank(retVal, i);
+                }
+            }
+        }
+
+        return retVal;
+    }
+
+    // Whether code (from GetCode) has str, not as part of a longer
+    // identifier or a property of something else, eg "I2C(" is not found
+    // in "myI2C(" or "x.I2C(", and "new DS18X" not in "new DS18XB"
+    static bool HasToken(const string &code, const string &str)
+    {
+        return FindToken(code, str) != string::npos;
+    }
+
+    static size_t FindToken(const string &code, const string &str, size_t posStart = 0)
+    {
+        size_t retVal = string::npos;
+
+        for (size_t pos = code.find(str, posStart); pos != string::npos; pos = code.find(str, pos + 1))
+        {
+            size_t end = pos + str.size();
+
+            bool startOk = pos == 0 || (IsIdChar(code[pos - 1]) == false && code[pos - 1] != '.');
+            bool endOk   = IsIdChar(str.back()) == false || end == code.size() || IsIdChar(code[end]) == false;
+
+            if (startOk && endOk)
+            {
+                retVal = pos;
+                break;
+            }
+        }
+
+        return retVal;
+    }
+
+    static bool IsIdChar(char c)
+    {
+        return isalnum((unsigned char)c) || c == '_' || c == '$';
+    }
+
+
+private:
+
+    static void Blank(string &str, size_t i)
+    {
+        if (i < str.size() && str[i] != '\n')
+        {
+            str[i] = ' ';
+        }
+    }
+};
@@ -0,0 +1,331 @@
+#pragma once
+
+#include "FilesystemLittleFS.h"
+#include "JerryScriptExt.h"
+#include "JerryScriptIntegration.h"
+#include "JSScriptScan.h"
+#include "Log.h"
+#include "Timeline.h"
+#include "Utl.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+
+// Sensor readings shared by the slot script runs of a window, so a sensor
+// is read once per window rather than by every script which uses it, and
+// so runs don't wait on sensors which were read ahead of time.
+//
+// Every reading made by a slot script is kept, timestamped, keyed like
+// "DS18X(12).GetTemperatureCelsius()". Until a reading is older than the
+// max age, any slot script asking for it gets the kept value instead of a
+// sensor read. The cache is cleared once the window is over.
+//
+// A prefetch run of a slot's script (eg at radio warmup) fills the cache,
+// and the keys it read are remembered for the slot. When the slot's script
+// later runs for real, if every one of those readings is still fresh, the
+// waits the script does for sensor conversions (DelayMs) are skipped, up to
+// the first call in the run which goes to hardware, that is, any call not
+// answered from the cache. From then on the script's waits are kept.
+//
+// Covered are the Get* methods of the sensor objects. Not covered are sys
+// and ADC, whose readings (eg input voltage under transmit load) change
+// from one slot to the next, and I2C and Pin, whose reads depend on what
+// was written before. Scripts which use I2C or Pin aren't prefetched, as
+// the prefetch run would repeat their writes.
+//
+// The JS side is a JSBindingHooks hook, which answers the getters, and
+// watches the other methods of the bindings for calls to hardware.
+//
+// The max age defaults to one 2 minute transmit window, so readings are
+// not carried between slots unless the max age is raised. It is kept in
+// its own versioned file, eg "v1 120000".
+class JSSensorCache
+{
+private:
+
+    inline static const char *FILE_NAME    = "sensorcache.txt";
+    inline static const char *FILE_VERSION = "v1";
+
+public:
+
+    static const uint32_t MAX_AGE_DEFAULT_MS =  2 * 60 * 1'000;
+    static const uint32_t MAX_AGE_MAX_MS     = 10 * 60 * 1'000;
+
+
+public:
+
+    void Load()
+    {
+        maxAgeMs_ = MAX_AGE_DEFAULT_MS;
+
+        vector<string> partList = Split(FilesystemLittleFS::Read(FILE_NAME), " ");
+
+        if (partList.size() == 2 && partList[0] == FILE_VERSION)
+        {
+            string err;
+            if (SetMaxAgeMs(partList[1], err) == false)
+            {
+                Log("ERR: Sensor cache: ", err);
+            }
+        }
+    }
+
+    bool Save() const
+    {
+        bool retVal = FilesystemLittleFS::Write(FILE_NAME, string{FILE_VERSION} + " " + to_string(maxAgeMs_));
+
+        if (retVal == false)
+        {
+            Log("ERR: Sensor cache: could not save");
+        }
+
+        return retVal;
+    }
+
+    bool SetMaxAgeMs(const string &str, string &err)
+    {
+        bool retVal = false;
+
+        uint32_t maxAgeMs = 0;
+        if (str == "" || str.find_first_not_of("0123456789") != string::npos || str.size() > 9)
+        {
+            err = "Max age \"" + str + "\" not a number";
+        }
+        else if ((maxAgeMs = (uint32_t)stoul(str)) > MAX_AGE_MAX_MS)
+        {
+            err = "Max age " + str + " ms over " + to_string(MAX_AGE_MAX_MS) + " ms";
+        }
+        else
+        {
+            maxAgeMs_ = maxAgeMs;
+            retVal = true;
+        }
+
+        return retVal;
+    }
+
+    uint32_t GetMaxAgeMs() const
+    {
+        return maxAgeMs_;
+    }
+
+    // Call in the running VM, before the script runs.
+    // Without keep, the cache is passed through: nothing is answered from
+    // it or put in it, but the run costs what a cached one does.
+    void Register(const string &slotName, bool prefetch, bool keep = true)
+    {
+        slotName_ = slotName;
+        prefetch_ = prefetch;
+        keep_     = keep;
+
+        if (prefetch_)
+        {
+            slotKeyListMap_[slotName_].clear();
+        }
+
+        JerryScript::UseThenFreeNewObj([&](auto obj){
+            JerryScript::SetGlobalPropertyNoFree("__sc", obj);
+
+            JerryScriptExt::SetPropertyToNativeFunction(obj, "Get", [this](const jerry_value_t argList[], jerry_length_t argCount){
+                return Get(JerryScriptExt::GetArgString(argList, argCount, 0));
+            });
+
+            JerryScriptExt::SetPropertyToNativeFunction(obj, "Set", [this](const jerry_value_t argList[], jerry_length_t argCount){
+                Set(JerryScriptExt::GetArgString(argList, argCount, 0), JerryScriptExt::GetArgNumber(argList, argCount, 1));
+
+                return jerry_undefined();
+            });
+
+            JerryScript::SetPropertyToNativeFunction(obj, "Skip", [this]{
+                return (double)CanSkipDelay();
+            });
+        });
+    }
+
+    // The caching hook, for JSBindingHooks
+    static const char *GetHook()
+    {
+        return HOOK;
+    }
+
+    // Uses in comments and strings don't count, see JSScriptScan
+    static bool ScriptUsesSensors(const string &script)
+    {
+        return CodeUsesSensors(JSScriptScan::GetCode(script));
+    }
+
+    // Raw I/O is never cached, and a prefetch run would repeat its writes
+    static bool ScriptUsesRawIo(const string &script)
+    {
+        return CodeUsesRawIo(JSScriptScan::GetCode(script));
+    }
+
+    static bool ScriptCanPrefetch(const string &script)
+    {
+        string code = JSScriptScan::GetCode(script);
+
+        return CodeUsesSensors(code) && CodeUsesRawIo(code) == false;
+    }
+
+    void Clear()
+    {
+        keyEntryMap_.clear();
+        slotKeyListMap_.clear();
+    }
+
+    void Print() const
+    {
+        uint64_t timeNowUs = PAL.Micros();
+
+        Log("Sensor cache: ", keyEntryMap_.size(), " readings, max age ", Commas(maxAgeMs_), " ms");
+        for (const auto &[key, entry] : keyEntryMap_)
+        {
+            Log("- ", StrUtl::PadRight(key, ' ', 40), " ", ToString(entry.value, 3), " (", Commas((timeNowUs - entry.timeUs) / 1'000), " ms old)");
+        }
+        for (const auto &[slotName, keyList] : slotKeyListMap_)
+        {
+            Log("- ", slotName, ": ", keyList.size(), " readings prefetched, ", IsFresh(keyList) ? "fresh" : "stale");
+        }
+    }
+
+
+private:
+
+    struct Entry
+    {
+        double   value  = 0;
+        uint64_t timeUs = 0;
+    };
+
+    static bool CodeUsesSensors(const string &code)
+    {
+        bool retVal = false;
+
+        for (const auto &ctor : SENSOR_CTOR_LIST)
+        {
+            retVal |= JSScriptScan::HasToken(code, string{"new "} + ctor);
+        }
+
+        return retVal;
+    }
+
+    static bool CodeUsesRawIo(const string &code)
+    {
+        bool retVal = false;
+
+        for (const auto &ctor : RAW_IO_CTOR_LIST)
+        {
+            retVal |= JSScriptScan::HasToken(code, string{ctor} + "(");
+        }
+
+        return retVal;
+    }
+
+    jerry_value_t Get(const string &key)
+    {
+        jerry_value_t retVal = jerry_undefined();
+
+        auto it = keyEntryMap_.find(key);
+
+        if (keep_ && it != keyEntryMap_.end() && IsFresh(it->second))
+        {
+            retVal = jerry_number(it->second.value);
+
+            RecordPrefetchKey(key);
+        }
+
+        return retVal;
+    }
+
+    void Set(const string &key, double value)
+    {
+        if (keep_ == false)
+        {
+            return;
+        }
+
+        keyEntryMap_[key] = { value, PAL.Micros() };
+
+        RecordPrefetchKey(key);
+    }
+
+    void RecordPrefetchKey(const string &key)
+    {
+        if (prefetch_)
+        {
+            vector<string> &keyList = slotKeyListMap_[slotName_];
+            if (find(keyList.begin(), keyList.end(), key) == keyList.end())
+            {
+                keyList.push_back(key);
+            }
+        }
+    }
+
+    bool CanSkipDelay() const
+    {
+        bool retVal = false;
+
+        if (keep_ && prefetch_ == false)
+        {
+            auto it = slotKeyListMap_.find(slotName_);
+
+            retVal = it != slotKeyListMap_.end() && it->second.size() && IsFresh(it->second);
+        }
+
+        return retVal;
+    }
+
+    bool IsFresh(const Entry &entry) const
+    {
+        return PAL.Micros() - entry.timeUs <= (uint64_t)maxAgeMs_ * 1'000;
+    }
+
+    bool IsFresh(const vector<string> &keyList) const
+    {
+        bool retVal = true;
+
+        for (const auto &key : keyList)
+        {
+            auto it = keyEntryMap_.find(key);
+
+            retVal &= it != keyEntryMap_.end() && IsFresh(it->second);
+        }
+
+        return retVal;
+    }
+
+
+private:
+
+    inline static const vector<const char *> SENSOR_CTOR_LIST = {
+        "BH1750", "BME280", "BMP280", "DS18X", "MMC56x3", "SI7021",
+    };
+
+    inline static const vector<const char *> RAW_IO_CTOR_LIST = {
+        "I2C", "Pin",
+    };
+
+    // kept to one line, ES5, and out of the way of script globals
+    inline static const char *HOOK =
+        "(function(){"
+        "var G=Function('return this')(),S=G.__sc,m=false,Z=['BH1750','BME280','BMP280','DS18X','MMC56x3','SI7021'];"
+        "G.__hk.push({o:['sys'],C:1,D:1,"
+        "call:function(w,k,a,n){if(w.c===''){if(m||!S.Skip()){return n();}return;}"
+        "if(Z.indexOf(w.c)<0||k.indexOf('Get')!==0){m=true;return n();}"
+        "var c=w.n+'.'+k+'('+Array.prototype.join.call(a,',')+')',v=S.Get(c);if(v!==undefined){return v;}"
+        "m=true;v=n();if(typeof v==='number'){S.Set(c,v);}return v;}});"
+        "})();";
+
+    uint32_t maxAgeMs_ = MAX_AGE_DEFAULT_MS;
+
+    string slotName_;
+    bool   prefetch_ = false;
+    bool   keep_     = true;
+
+    map<string, Entry>          keyEntryMap_;
+    map<string, vector<string>> slotKeyListMap_;
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "jerryscript.h"
+
+#include <functional>
+#include <string>
+using namespace std;
+
+
+// Helpers over the JerryScript C API for what the JerryScript integration
+// doesn't cover, eg reading values back out of a script's globals.
+//
+// All of these assume the VM is running.
+class JerryScriptExt
+{
+public:
+
+    // A native function which takes arguments, returning a value the VM
+    // takes ownership of
+    using NativeFn = function<jerry_value_t(const jerry_value_t argList[], jerry_length_t argCount)>;
+
+    // Returns a value which must be freed
+    static jerry_value_t GetGlobalProperty(const char *name)
+    {
+        jerry_value_t global = jerry_current_realm();
+        jerry_value_t retVal = jerry_object_get_sz(global, name);
+        jerry_value_free(global);
+
+        return retVal;
+    }
+
+    static double GetPropertyNumber(jerry_value_t obj, const char *name, double defaultValue = 0)
+    {
+        double retVal = defaultValue;
+
+        jerry_value_t val = jerry_object_get_sz(obj, name);
+        if (jerry_value_is_number(val))
+        {
+            retVal = jerry_value_as_number(val);
+        }
+        jerry_value_free(val);
+
+        return retVal;
+    }
+
+    static string ToString(jerry_value_t val)
+    {
+        string retVal;
+
+        jerry_value_t str = jerry_value_is_string(val) ? jerry_value_copy(val) : jerry_value_to_string(val);
+
+        if (jerry_value_is_exception(str) == false)
+        {
+            jerry_size_t size = jerry_string_size(str, JERRY_ENCODING_UTF8);
+
+            retVal.resize(size);
+            jerry_string_to_buffer(str, JERRY_ENCODING_UTF8, (jerry_char_t *)retVal.data(), size);
+        }
+
+        jerry_value_free(str);
+
+        return retVal;
+    }
+
+    // Calls fn with each own enumerable key of obj and its value
+    static void ForEachProperty(jerry_value_t obj, function<void(const string &key, jerry_value_t val)> fn)
+    {
+        jerry_value_t keyList = jerry_object_keys(obj);
+
+        if (jerry_value_is_exception(keyList) == false)
+        {
+            uint32_t len = jerry_array_length(keyList);
+
+            for (uint32_t i = 0; i < len; ++i)
+            {
+                jerry_value_t key = jerry_object_get_index(keyList, i);
+                jerry_value_t val = jerry_object_get(obj, key);
+
+                fn(ToString(key), val);
+
+                jerry_value_free(val);
+                jerry_value_free(key);
+            }
+        }
+
+        jerry_value_free(keyList);
+    }
+
+    // Line of the innermost script frame running now, 0 if not known
+    static uint32_t GetCurrentLine()
+    {
+        uint32_t retVal = 0;
+
+        jerry_backtrace_capture([](jerry_frame_t *frame, void *userData){
+            const jerry_frame_location_t *loc = jerry_frame_location(frame);
+
+            if (loc)
+            {
+                *(uint32_t *)userData = loc->line;
+            }
+
+            // stop at the first frame with a location
+            return loc == nullptr;
+        }, &retVal);
+
+        return retVal;
+    }
+
+    static void SetPropertyToNativeFunction(jerry_value_t obj, const char *name, NativeFn fn)
+    {
+        jerry_value_t fnObj = jerry_function_external(OnNativeCall);
+
+        // the VM frees the function along with the object holding it
+        jerry_object_set_native_ptr(fnObj, &NATIVE_FN_INFO, new NativeFn(fn));
+
+        jerry_value_free(jerry_object_set_sz(obj, name, fnObj));
+        jerry_value_free(fnObj);
+    }
+
+    static string GetArgString(const jerry_value_t argList[], jerry_length_t argCount, jerry_length_t idx)
+    {
+        return idx < argCount ? ToString(argList[idx]) : "";
+    }
+
+    static double GetArgNumber(const jerry_value_t argList[], jerry_length_t argCount, jerry_length_t idx, double defaultValue = 0)
+    {
+        return idx < argCount && jerry_value_is_number(argList[idx]) ? jerry_value_as_number(argList[idx]) : defaultValue;
+    }
+
+
+private:
+
+    static jerry_value_t OnNativeCall(const jerry_call_info_t *callInfo, const jerry_value_t argList[], const jerry_length_t argCount)
+    {
+        NativeFn *fn = (NativeFn *)jerry_object_get_native_ptr(callInfo->function, &NATIVE_FN_INFO);
+
+        return fn ? (*fn)(argList, argCount) : jerry_undefined();
+    }
+
+    inline static const jerry_object_native_info_t NATIVE_FN_INFO = {
+        .free_cb = [](void *ptr, jerry_object_native_info_t *){
+            delete (NativeFn *)ptr;
+        },
+    };
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "GPS.h"
+#include "Log.h"
+#include "Utl.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+
+// Measures the system timebase (the MCU crystal) against the GPS PPS.
+//
+// Each FixTime carries the system time its PPS edge was captured at, and
+// the GPS time of that edge. Over a run of seconds, a least-squares line
+// of system time against GPS time gives the timebase frequency error,
+// averaging out the per-edge capture jitter. Missed seconds don't matter
+// since each sample is placed by its own GPS time.
+//
+// The clockgen has its own reference, so this is no measure of the
+// transmit frequency.
+class PpsTimebaseCheck
+{
+public:
+
+    struct Result
+    {
+        bool     ok           = false;
+        uint16_t sampleCount  = 0;
+        uint32_t spanSec      = 0;
+        double   errPpb       = 0;    // positive when the system clock runs fast
+        double   residualUs   = 0;    // worst sample distance from the fit
+    };
+
+    static const uint16_t SAMPLE_COUNT_MIN = 5;
+    static const uint32_t SPAN_SEC_MIN     = 5;
+
+
+public:
+
+    void Start(uint32_t durationSec)
+    {
+        durationSec_ = durationSec;
+
+        sampleCount_ = 0;
+        sumX_  = 0;
+        sumY_  = 0;
+        sumXX_ = 0;
+        sumXY_ = 0;
+
+        xList_.clear();
+        yList_.clear();
+    }
+
+    // Returns true once the duration is covered
+    bool OnFixTime(const FixTime &fix)
+    {
+        uint32_t secOfDay = fix.hour * 3600 + fix.minute * 60 + fix.second;
+
+        if (sampleCount_ == 0)
+        {
+            secOfDayFirst_ = secOfDay;
+            timeFirstUs_   = fix.timeAtPpsUs;
+        }
+
+        // seconds since the first sample, across midnight too
+        uint32_t x = (secOfDay + SEC_PER_DAY - secOfDayFirst_) % SEC_PER_DAY;
+        double   y = (double)(int64_t)(fix.timeAtPpsUs - timeFirstUs_);
+
+        // ignore a repeat of a second already seen
+        if (sampleCount_ && x <= xList_.back())
+        {
+            return false;
+        }
+
+        ++sampleCount_;
+        sumX_  += x;
+        sumY_  += y;
+        sumXX_ += (double)x * x;
+        sumXY_ += x * y;
+
+        xList_.push_back(x);
+        yList_.push_back(y);
+
+        return x >= durationSec_;
+    }
+
+    Result GetResult() const
+    {
+        Result retVal;
+
+        retVal.sampleCount = sampleCount_;
+        retVal.spanSec     = sampleCount_ ? xList_.back() : 0;
+
+        if (sampleCount_ >= SAMPLE_COUNT_MIN && retVal.spanSec >= SPAN_SEC_MIN)
+        {
+            double n = sampleCount_;
+
+            // system us per GPS second
+            double slope     = (n * sumXY_ - sumX_ * sumY_) / (n * sumXX_ - sumX_ * sumX_);
+            double intercept = (sumY_ - slope * sumX_) / n;
+
+            retVal.errPpb = (slope - 1'000'000.0) * 1'000.0;
+
+            for (size_t i = 0; i < xList_.size(); ++i)
+            {
+                double residual = fabs(yList_[i] - (intercept + slope * xList_[i]));
+
+                retVal.residualUs = max(retVal.residualUs, residual);
+            }
+
+            retVal.ok = true;
+        }
+
+        return retVal;
+    }
+
+    static void Print(const Result &result)
+    {
+        Log("PPS timebase check ", result.ok ? "ok" : "FAILED",
+            ": ", result.sampleCount, " samples over ", result.spanSec, " sec");
+
+        if (result.ok)
+        {
+            Log("- mcu clock error : ", ToString(result.errPpb / 1'000.0, 3), " ppm");
+            Log("- worst residual  : ", ToString(result.residualUs, 1), " us");
+        }
+    }
+
+
+private:
+
+    static const uint32_t SEC_PER_DAY = 24 * 60 * 60;
+
+    uint32_t durationSec_ = 0;
+
+    uint16_t sampleCount_   = 0;
+    uint32_t secOfDayFirst_ = 0;
+    uint64_t timeFirstUs_   = 0;
+
+    double sumX_  = 0;
+    double sumY_  = 0;
+    double sumXX_ = 0;
+    double sumXY_ = 0;
+
+    vector<uint32_t> xList_;
+    vector<double>   yList_;
+};
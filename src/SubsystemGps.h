@@ -5,6 +5,10 @@
 #include "JSONMsgRouter.h"
 #include "TimeClass.h"
 
+#include "GpsSatStats.h"
+#include "GpsWarmStart.h"
+#include "PpsTimebaseCheck.h"
+
 
 class SubsystemGps
 {
@@ -14,6 +18,11 @@ public:
     {
         UartDisable(UART::UART_1);
 
+        // NMEA is also parsed here, for anything GPSReader doesn't expose
+        UartAddLineStreamCallback(UART::UART_1, [this](const string &line){
+            OnNmeaLine(line);
+        });
+
         Disable();
 
         SetupShell();
@@ -41,25 +50,27 @@ public:
     {
         ModulePowerOnBatteryOn();
 
-        // Have GPSWriter watch for NMEA/UBX messages (replies to commands)
-        gpsWriter_.Reset();
-        gpsWriter_.StartMonitorForReplies();
+        // Issue commands to set params and save configuration, but only
+        // those not already known to be applied
+        ApplyModuleConfiguration({
+            .highAltitude   = true,
+            .maxGpsMessages = maxGpsMessages,
+        });
 
-        // Issue commands to set params and save configuration
-        gpsWriter_.SendHighAltitudeMode();
-        if (maxGpsMessages)
+        // First enable after boot gets the position (and maybe time) which
+        // survived the reboot, to turn a cold start into a warm one
+        if (warmStartPending_)
         {
-            gpsWriter_.SendModuleMessageRateConfigurationMaximal();
-        }
-        else
-        {
-            gpsWriter_.SendModuleMessageRateConfigurationMinimal();
+            warmStartPending_ = false;
+
+            warmStart_.SendAiding();
         }
-        gpsWriter_.SendModuleSaveConfiguration();
 
         // Start decoding NMEA
         gpsReader_.Reset();
         gpsReader_.StartMonitoring();
+        satStats_.Reset();
+        nmeaEnabled_ = true;
     }
 
     void RequestNewFixTimeAnd3DPlus(function<void(const FixTime   &)> fnCbOnFixTime,
@@ -80,6 +91,7 @@ public:
             // GPS module already only lets time through when milliseconds are zero and
             // a good time has been seen twice consecutively (and this callback is on
             // the second). No additional filtering required here.
+            warmStart_.OnFixTime(fix);
             fnCbOnFixTime(fix);
 
             gpsReader_.UnSetCallbackOnFixTime();
@@ -101,6 +113,7 @@ public:
                 Log("Got Fix3DPlus in ", Time::MakeTimeMMSSmmmFromMs(PAL.Millis() - timeStart), " at GPS Time ", fix.dateTime, " UTC");
                 fix.Print();
                 LogNL();
+                warmStart_.OnFix3DPlus(fix);
                 fnCbOnFix3dPlus(fix);
                 gpsReader_.UnSetCallbackOnFix3DPlus();
             }
@@ -116,6 +129,8 @@ public:
     {
         Log("GPS Monitor Mode");
 
+        satStatsToJson_ = true;
+
         UartAddLineStreamCallback(UART::UART_1, [this](const string &line){
             if (NMEAStringParser::IsValid(line))
             {
@@ -133,6 +148,7 @@ public:
     {
         gpsReader_.StopMonitoring();
         gpsWriter_.StopMonitorForReplies();
+        nmeaEnabled_ = false;
 
         ModulePowerOffBatteryOn();
     }
@@ -141,10 +157,75 @@ public:
     {
         return gpsReader_;
     }
+
+    const GpsSatStats &GetSatStats() const
+    {
+        return satStats_;
+    }
+
+    // Call before a deliberate reboot so that the next boot can warm start
+    void SaveWarmStartBeforeReboot()
+    {
+        warmStart_.SaveTimeBeforeReboot();
+    }
+
+    // Measures the MCU timebase against the PPS over durationSec.
+    //
+    // The GPS must already be on. The FixTime callback is taken over
+    // until done, and the callback is called with the result either way.
+    void StartPpsTimebaseCheck(uint32_t durationSec, function<void(const PpsTimebaseCheck::Result &)> fnCb)
+    {
+        Log("PPS timebase check starting, ", durationSec, " sec");
+
+        ppsTimebaseCheck_.Start(durationSec);
+        fnCbPpsCheck_ = fnCb;
+
+        gpsReader_.SetCallbackOnFixTime([this](const FixTime &fix){
+            if (ppsTimebaseCheck_.OnFixTime(fix))
+            {
+                EndPpsTimebaseCheck();
+            }
+        });
+
+        // give up if time doesn't arrive, allowing for getting a lock
+        timerPpsCheck_.SetName("TIMER_GPS_PPS_TIMEBASE_CHECK");
+        timerPpsCheck_.SetCallback([this]{
+            EndPpsTimebaseCheck();
+        });
+        timerPpsCheck_.TimeoutInMs((durationSec + PPS_CHECK_LOCK_ALLOWANCE_SEC) * 1'000);
+    }
+
+    bool PpsTimebaseCheckInProgress() const
+    {
+        return (bool)fnCbPpsCheck_;
+    }
     
 
 private:
 
+    void EndPpsTimebaseCheck()
+    {
+        timerPpsCheck_.Cancel();
+        gpsReader_.UnSetCallbackOnFixTime();
+
+        PpsTimebaseCheck::Result result = ppsTimebaseCheck_.GetResult();
+        PpsTimebaseCheck::Print(result);
+
+        // the web page in monitor mode wants its time updates back
+        if (satStatsToJson_)
+        {
+            StartMonitorLockSequenceWeb();
+        }
+
+        auto fnCb = fnCbPpsCheck_;
+        fnCbPpsCheck_ = nullptr;
+
+        if (fnCb)
+        {
+            fnCb(result);
+        }
+    }
+
     void StartMonitorLockSequenceWeb()
     {
         Log("StartMonitorLockSequenceWeb");
@@ -220,6 +301,9 @@ public:
         ModulePowerOffBatteryOn(false);
 
         pinGpsBatteryPowerOnOff_.DigitalWrite(0);
+
+        // battery-backed configuration is gone
+        ForgetModuleConfiguration();
     }
 
     void ModuleHardReset()
@@ -227,11 +311,144 @@ public:
         gpsWriter_.SendModuleFactoryResetConfiguration();
         gpsWriter_.SendModuleResetColdCasic();
 
+        ForgetModuleConfiguration();
+
         ModulePowerOff();
         PAL.Delay(1'000);
         ModulePowerOnBatteryOn();
     }
 
+private:
+
+    /////////////////////////////////////////////////////////////////
+    // NMEA Parsing
+    /////////////////////////////////////////////////////////////////
+
+    void OnNmeaLine(const string &line)
+    {
+        GpsSatStats::Gsv gsv;
+
+        if (nmeaEnabled_ && GpsSatStats::ParseGsv(line, gsv))
+        {
+            if (satStats_.OnGsv(gsv, PAL.Micros()) && satStatsToJson_)
+            {
+                SendSatStatsJson(gsv.talker);
+            }
+        }
+    }
+
+    // Sent as each constellation completes an epoch
+    void SendSatStatsJson(const char *talker)
+    {
+        for (uint8_t i = 0; i < GpsSatStats::CONSTELLATION_COUNT; ++i)
+        {
+            GpsSatStats::Constellation con = (GpsSatStats::Constellation)i;
+
+            if (strcmp(GpsSatStats::GetTalker(con), talker) != 0)
+            {
+                continue;
+            }
+
+            const GpsSatStats::Stats &stats = satStats_.Get(con);
+
+            router_.Send([&](const auto &out){
+                out["type"] = "GPS_SAT_STATS";
+                out["constellation"] = talker;
+                out["inView"]  = stats.inView;
+                out["tracked"] = stats.tracked;
+                out["cn0Mean"] = stats.cn0Mean;
+                out["cn0Max"]  = stats.cn0Max;
+                for (uint8_t bin = 0; bin < GpsSatStats::ELEV_BIN_COUNT; ++bin)
+                {
+                    string key = string{"elev"} + GpsSatStats::GetElevBinName(bin);
+                    out[key.c_str()] = stats.elevBinList[bin];
+                }
+            });
+        }
+    }
+
+
+private:
+
+    /////////////////////////////////////////////////////////////////
+    // Module Configuration
+    /////////////////////////////////////////////////////////////////
+
+    // The module keeps its configuration in battery-backed RAM, which
+    // survives ModulePowerOffBatteryOn(). Track what was last applied so
+    // that each enable only sends what differs.
+    //
+    // The module can't be queried for this cheaply, so the tracked state
+    // is re-verified by sending everything periodically anyway, in case
+    // the module lost it in some way not seen here (eg brownout of the
+    // backup supply).
+
+    struct ModuleConfig
+    {
+        bool highAltitude   = false;
+        bool maxGpsMessages = false;
+    };
+
+    static const uint8_t MODULE_CONFIG_VERIFY_INTERVAL = 6;
+
+    void ApplyModuleConfiguration(const ModuleConfig &cfg)
+    {
+        bool verify = moduleConfigKnown_ == false || moduleConfigEnableCount_ >= MODULE_CONFIG_VERIFY_INTERVAL;
+
+        bool sendHighAltitude = verify || cfg.highAltitude   != moduleConfig_.highAltitude;
+        bool sendMessageRate  = verify || cfg.maxGpsMessages != moduleConfig_.maxGpsMessages;
+
+        ++moduleConfigEnableCount_;
+
+        if (sendHighAltitude == false && sendMessageRate == false)
+        {
+            Log("GPS module configuration already applied, not sending");
+
+            return;
+        }
+
+        Log("GPS module configuration", verify ? " (verify)" : "", ":",
+            sendHighAltitude ? " high-altitude" : "",
+            sendMessageRate  ? " message-rate"  : "");
+
+        // Have GPSWriter watch for NMEA/UBX messages (replies to commands)
+        gpsWriter_.Reset();
+        gpsWriter_.StartMonitorForReplies();
+
+        if (sendHighAltitude && cfg.highAltitude)
+        {
+            gpsWriter_.SendHighAltitudeMode();
+        }
+
+        if (sendMessageRate)
+        {
+            if (cfg.maxGpsMessages)
+            {
+                gpsWriter_.SendModuleMessageRateConfigurationMaximal();
+            }
+            else
+            {
+                gpsWriter_.SendModuleMessageRateConfigurationMinimal();
+            }
+        }
+
+        gpsWriter_.SendModuleSaveConfiguration();
+
+        moduleConfig_      = cfg;
+        moduleConfigKnown_ = true;
+
+        if (verify)
+        {
+            moduleConfigEnableCount_ = 0;
+        }
+    }
+
+    void ForgetModuleConfiguration()
+    {
+        moduleConfigKnown_ = false;
+    }
+
+
 private:
 
     /////////////////////////////////////////////////////////////////
@@ -494,6 +711,16 @@ private:
             MonitorLockSequence({});
         }, { .argCount = 0, .help = "gps monitor lock sequence"});
 
+        Shell::AddCommand("app.ss.gps.warm", [this](vector<string> argList){
+            if      (argList[0] == "show") { warmStart_.Print();       }
+            else if (argList[0] == "send") { warmStart_.SendAiding();  }
+            else if (argList[0] == "del")  { warmStart_.Delete();      }
+        }, { .argCount = 1, .help = "gps warm start <show/send/del>"});
+
+        Shell::AddCommand("app.ss.gps.sat", [this](vector<string> argList){
+            satStats_.Print();
+        }, { .argCount = 0, .help = "gps satellite statistics by constellation"});
+
         Shell::AddCommand("app.ss.gps.bat", [this](vector<string> argList){
             if (argList[0] == "on") { pinGpsBatteryPowerOnOff_.DigitalWrite(1);  }
             else                    { pinGpsBatteryPowerOnOff_.DigitalWrite(0); }
@@ -547,4 +774,21 @@ private:
 
     GPSReader gpsReader_;
     GPSWriter gpsWriter_;
+
+    bool nmeaEnabled_ = false;
+
+    GpsSatStats satStats_;
+    bool satStatsToJson_ = false;
+
+    GpsWarmStart warmStart_;
+    bool warmStartPending_ = true;
+
+    static const uint32_t PPS_CHECK_LOCK_ALLOWANCE_SEC = 90;
+    PpsTimebaseCheck ppsTimebaseCheck_;
+    function<void(const PpsTimebaseCheck::Result &)> fnCbPpsCheck_;
+    Timer timerPpsCheck_;
+
+    ModuleConfig moduleConfig_;
+    bool moduleConfigKnown_ = false;
+    uint8_t moduleConfigEnableCount_ = 0;
 };
\ No newline at end of file
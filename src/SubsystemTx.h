@@ -1,11 +1,20 @@
 #pragma once
 
+#include "ADCInternal.h"
 #include "App.h"
+#include "FilesystemLittleFS.h"
 #include "JSONMsgRouter.h"
+#include "TempSensorInternal.h"
 #include "WsprEncodedDynamic.h"
 #include "WSPRMessageTransmitter.h"
 
 #include "Configuration.h"
+#include "TxLaneHop.h"
+#include "TxPlan.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
 
 
 // Do we want a warmup period before sending?
@@ -18,8 +27,14 @@ public:
 
     SubsystemTx()
     {
+        wsprMessageTransmitter_.SetQuitEarlyFunction([this](uint64_t msSinceStart){
+            return OnTxProgress(msSinceStart);
+        });
+
         Disable();
 
+        LoadTxPolicy();
+
         SetupShell();
         SetupJSON();
     }
@@ -90,22 +105,142 @@ public:
         wsprMessageTransmitter_.SetCorrection(cfg_.correction);
     }
 
+    // In flight the stored configuration can't change, so it is read from
+    // flash and mapped to its channel(s) once, and reused for every window.
+    //
+    // With a TX plan, windows rotate through its (band, channel) entries,
+    // otherwise the configured band and channel are used for all.
+    //
+    // If the plan enables lane hopping, the day's offsets for each
+    // channel are worked out here too.
+    //
+    // This saves only the flash read and channel lookup per window. The
+    // clock generator values for each tone are still worked out by the
+    // transmitter, per symbol, out of reach from here.
+    void LockFlightConfiguration()
+    {
+        cfg_.Get();
+
+        flightEntryList_.clear();
+        if (txPlan_.Load())
+        {
+            flightEntryList_ = txPlan_.GetEntryList();
+
+            Log("TX plan: ", txPlan_.ToString());
+        }
+        else
+        {
+            flightEntryList_.push_back({ cfg_.band, cfg_.channel });
+        }
+
+        flightCdList_.clear();
+        for (const auto &e : flightEntryList_)
+        {
+            flightCdList_.push_back(WsprChannelMap::GetChannelDetails(e.band.c_str(), e.channel));
+        }
+        flightCdIdx_ = 0;
+
+        flightHopList_.clear();
+        if (txPlan_.GetHop())
+        {
+            for (const auto &cd : flightCdList_)
+            {
+                flightHopList_.emplace_back();
+                flightHopList_.back().Build(cd.id13);
+            }
+
+            Log("TX lane hopping enabled");
+        }
+
+        flightCfgLocked_ = true;
+    }
+
+    // Returns true if the channel details changed
+    bool AdvanceTxPlan()
+    {
+        bool retVal = false;
+
+        if (flightCfgLocked_ && flightCdList_.size() > 1)
+        {
+            flightCdIdx_ = (flightCdIdx_ + 1) % flightCdList_.size();
+
+            retVal = true;
+
+            const TxPlan::Entry &e = flightEntryList_[flightCdIdx_];
+            Log("TX plan now at entry ", flightCdIdx_, ": ", e.band, ":", e.channel, " (min ", flightCdList_[flightCdIdx_].min, ")");
+        }
+
+        return retVal;
+    }
+
+    // The band and channel in use, which are the TX plan's current entry
+    // in flight if there is a plan
+    TxPlan::Entry GetBandAndChannel() const
+    {
+        TxPlan::Entry retVal = { cfg_.band, cfg_.channel };
+
+        if (flightCfgLocked_)
+        {
+            retVal = flightEntryList_[flightCdIdx_];
+        }
+
+        return retVal;
+    }
+
+    WsprChannelMap::ChannelDetails GetChannelDetails()
+    {
+        WsprChannelMap::ChannelDetails retVal;
+
+        if (flightCfgLocked_)
+        {
+            retVal = flightCdList_[flightCdIdx_];
+        }
+        else
+        {
+            retVal = WsprChannelMap::GetChannelDetails(cfg_.band.c_str(), cfg_.channel);
+        }
+
+        return retVal;
+    }
+
     void SetupTransmitterForFlight()
     {
         // make sure config is the stored version
-        cfg_.Get();
+        if (flightCfgLocked_ == false)
+        {
+            cfg_.Get();
+        }
 
-        WsprChannelMap::ChannelDetails cd = WsprChannelMap::GetChannelDetails(cfg_.band.c_str(), cfg_.channel);
+        WsprChannelMap::ChannelDetails cd = GetChannelDetails();
+        TxPlan::Entry                  bc = GetBandAndChannel();
+
+        int8_t hopOffsetHz = GetHopOffsetHz();
 
         Log("Setup Transmitter (Flight mode)");
-        Log("Band: ", cfg_.band, ", Channel: ", cfg_.channel);
-        Log("Freq: ", Commas(cd.freq), ", Correction: ", cfg_.correction);
+        Log("Band: ", bc.band, ", Channel: ", bc.channel);
+        Log("Freq: ", Commas(cd.freq + hopOffsetHz), " (hop ", hopOffsetHz, "), Correction: ", cfg_.correction);
         LogNL();
 
-        wsprMessageTransmitter_.SetFrequency(cd.freq);
+        wsprMessageTransmitter_.SetFrequency(cd.freq + hopOffsetHz);
         wsprMessageTransmitter_.SetCorrection(cfg_.correction);
     }
 
+    // Setup happens at warmup, shortly before the window starts, so the
+    // window is the one a minute from now
+    int8_t GetHopOffsetHz()
+    {
+        int8_t retVal = 0;
+
+        if (flightCfgLocked_ && flightHopList_.size())
+        {
+            auto t = Time::ParseDateTime(Time::GetNotionalDateTimeAtSystemUs(PAL.Micros() + 60 * 1'000 * 1'000));
+
+            retVal = flightHopList_[flightCdIdx_].GetOffsetHz(TxLaneHop::GetWindowIdx(t.hour, t.minute));
+        }
+
+        return retVal;
+    }
+
     void SetCallbackOnTxStart(function<void()> fn)
     {
         wsprMessageTransmitter_.SetCallbackOnTxStart(fn);
@@ -123,18 +258,7 @@ public:
 
     void SetTxQuitAfterMs(uint64_t ms)
     {
-        if (ms == 0)
-        {
-            wsprMessageTransmitter_.SetQuitEarlyFunction([=](uint64_t msSinceStart){
-                return false;
-            });
-        }
-        else
-        {
-            wsprMessageTransmitter_.SetQuitEarlyFunction([=](uint64_t msSinceStart){
-                return msSinceStart >= ms;
-            });
-        }
+        policy_.quitAfterMs = ms;
     }
 
     void SendRegularMessage(string callsign, string grid4, uint8_t powerDbm)
@@ -187,9 +311,16 @@ public:
 
     void SendMessage(const WsprMessageRegularType1 &msg)
     {
+        if (TxPolicySaysSkip())
+        {
+            return;
+        }
+
         Log("Transmitting WSPR Type1: ", msg.GetCallsign(), " ", msg.GetGrid4(), " ", msg.GetPowerDbm());
 
+        StartTxRecord();
         wsprMessageTransmitter_.Send(msg.GetCallsign(), msg.GetGrid4(), msg.GetPowerDbm());
+        EndTxRecord();
     }
 
     void RadioOff()
@@ -211,6 +342,309 @@ public:
     }
 
 
+private:
+
+    /////////////////////////////////////////////////////////////////
+    // TX Policy
+    /////////////////////////////////////////////////////////////////
+
+    // Conditions under which a transmission is ended early, or not
+    // started at all.
+    //
+    // Supply voltage is watched under load, as a sagging supply leads to
+    // a brownout and reboot, which loses far more than one message.
+    // The voltage curve of each TX is kept so that the sag to expect can
+    // be predicted before starting the next one.
+    //
+    // There's no flight data yet to set a voltage threshold by, so none
+    // is applied unless one is set.
+    //
+    // The policy thresholds (not quitAfterMs, which the app sets each
+    // window) and the recent TX records are kept in flash, so that a
+    // reboot neither drops the limits nor the sag history used to
+    // predict. Stored as text, a version and thresholds line, then one
+    // line per record, eg:
+    //   v1 3100 -60 70
+    //   3280 3150 -12 110592 vcc 3280,3190,3160
+    inline static const char *POLICY_FILE_NAME    = "txpolicy.txt";
+    inline static const char *POLICY_FILE_VERSION = "v1";
+
+    struct TxPolicy
+    {
+        uint64_t quitAfterMs = 0;       // 0 = no limit
+        uint16_t minVccMv    = 0;       // 0 = no limit
+        int16_t  minTempC    = -100;
+        int16_t  maxTempC    = 100;
+    };
+
+    struct TxRecord
+    {
+        static const uint8_t SAMPLE_COUNT_MAX = 12;
+
+        uint16_t vccStartMv  = 0;
+        uint16_t vccMinMv    = 0;
+        int16_t  tempStartC  = 0;
+        uint32_t durationMs  = 0;
+        const char *quitReason = "";
+
+        uint8_t  sampleCount = 0;
+        array<uint16_t, SAMPLE_COUNT_MAX> vccMvList = {};
+    };
+
+    static const uint32_t POLICY_CHECK_INTERVAL_MS  = 1'000;
+    static const uint32_t RECORD_SAMPLE_INTERVAL_MS = 10'000;
+    static const uint8_t  RECORD_COUNT_MAX          = 8;
+    static const uint8_t  RECORD_COUNT_TO_PREDICT   = 2;
+
+    // Checked before TX, using the sag seen on recent TXs.
+    // Those which quit count too, the sag seen up to the quit is at least
+    // what a full TX would have seen, and leaving out the ones which quit
+    // on low voltage would leave out the worst sags.
+    bool TxPolicySaysSkip()
+    {
+        bool retVal = false;
+
+        if (policy_.minVccMv == 0)
+        {
+            return false;
+        }
+
+        uint32_t sagSum = 0;
+        uint8_t  sagCount = 0;
+        for (uint8_t i = 0; i < recordCount_; ++i)
+        {
+            const TxRecord &r = recordList_[i];
+
+            if (r.vccStartMv > r.vccMinMv)
+            {
+                sagSum += r.vccStartMv - r.vccMinMv;
+                ++sagCount;
+            }
+        }
+
+        if (sagCount >= RECORD_COUNT_TO_PREDICT)
+        {
+            uint16_t vccNowMv  = ADC::GetMilliVoltsVCC();
+            uint16_t sagMv     = sagSum / sagCount;
+            int32_t  vccPredMv = (int32_t)vccNowMv - sagMv;
+
+            if (vccPredMv < policy_.minVccMv)
+            {
+                retVal = true;
+
+                ++skipCount_;
+
+                Log("TX skipped - VCC ", Commas(vccNowMv), " mV would sag ", Commas(sagMv), " mV to below ", Commas(policy_.minVccMv), " mV");
+            }
+        }
+
+        return retVal;
+    }
+
+    void StartTxRecord()
+    {
+        txRecord_ = TxRecord{};
+        txRecord_.vccStartMv = ADC::GetMilliVoltsVCC();
+        txRecord_.vccMinMv   = txRecord_.vccStartMv;
+        txRecord_.tempStartC = (int16_t)TempSensorInternal::GetTempC();
+        txRecord_.vccMvList[txRecord_.sampleCount++] = txRecord_.vccStartMv;
+
+        msAtLastPolicyCheck_ = 0;
+    }
+
+    void EndTxRecord()
+    {
+        // shift out oldest
+        if (recordCount_ == RECORD_COUNT_MAX)
+        {
+            rotate(recordList_.begin(), recordList_.begin() + 1, recordList_.end());
+            --recordCount_;
+        }
+
+        recordList_[recordCount_++] = txRecord_;
+
+        // TX is over, safe to write
+        SaveTxPolicy();
+    }
+
+    // Quit reasons are kept as the literals OnTxProgress uses
+    static const char *QuitReasonFromStr(const string &str)
+    {
+        const char *retVal = "";
+
+        if      (str == "time") { retVal = "time limit";  }
+        else if (str == "vcc")  { retVal = "low vcc";     }
+        else if (str == "temp") { retVal = "temperature"; }
+
+        return retVal;
+    }
+
+    static const char *QuitReasonToStr(const char *quitReason)
+    {
+        string reason = quitReason;
+
+        const char *retVal = "-";
+
+        if      (reason == "time limit")  { retVal = "time"; }
+        else if (reason == "low vcc")     { retVal = "vcc";  }
+        else if (reason == "temperature") { retVal = "temp"; }
+
+        return retVal;
+    }
+
+    void LoadTxPolicy()
+    {
+        vector<string> lineList = Split(FilesystemLittleFS::Read(POLICY_FILE_NAME), "\n");
+
+        if (lineList.empty())
+        {
+            return;
+        }
+
+        vector<string> partList = Split(lineList[0], " ");
+
+        if (partList.size() != 4 || partList[0] != POLICY_FILE_VERSION)
+        {
+            return;
+        }
+
+        policy_.minVccMv = (uint16_t)atoi(partList[1].c_str());
+        policy_.minTempC = (int16_t)atoi(partList[2].c_str());
+        policy_.maxTempC = (int16_t)atoi(partList[3].c_str());
+
+        recordCount_ = 0;
+        for (size_t i = 1; i < lineList.size() && recordCount_ < RECORD_COUNT_MAX; ++i)
+        {
+            partList = Split(lineList[i], " ");
+
+            if (partList.size() == 6)
+            {
+                TxRecord r;
+                r.vccStartMv = (uint16_t)atoi(partList[0].c_str());
+                r.vccMinMv   = (uint16_t)atoi(partList[1].c_str());
+                r.tempStartC = (int16_t)atoi(partList[2].c_str());
+                r.durationMs = (uint32_t)atol(partList[3].c_str());
+                r.quitReason = QuitReasonFromStr(partList[4]);
+
+                for (const auto &sample : Split(partList[5], ","))
+                {
+                    if (r.sampleCount < TxRecord::SAMPLE_COUNT_MAX)
+                    {
+                        r.vccMvList[r.sampleCount++] = (uint16_t)atoi(sample.c_str());
+                    }
+                }
+
+                recordList_[recordCount_++] = r;
+            }
+        }
+    }
+
+    bool SaveTxPolicy()
+    {
+        string data = string{POLICY_FILE_VERSION} + " " +
+                      to_string(policy_.minVccMv) + " " +
+                      to_string(policy_.minTempC) + " " +
+                      to_string(policy_.maxTempC) + "\n";
+
+        for (uint8_t i = 0; i < recordCount_; ++i)
+        {
+            const TxRecord &r = recordList_[i];
+
+            string curve;
+            for (uint8_t j = 0; j < r.sampleCount; ++j)
+            {
+                curve += (j ? "," : "") + to_string(r.vccMvList[j]);
+            }
+
+            data += to_string(r.vccStartMv) + " " +
+                    to_string(r.vccMinMv)   + " " +
+                    to_string(r.tempStartC) + " " +
+                    to_string(r.durationMs) + " " +
+                    QuitReasonToStr(r.quitReason) + " " +
+                    (curve.empty() ? "0" : curve) + "\n";
+        }
+
+        bool retVal = FilesystemLittleFS::Write(POLICY_FILE_NAME, data);
+
+        if (retVal == false)
+        {
+            Log("ERR: TX policy: could not save");
+        }
+
+        return retVal;
+    }
+
+    // Called by the transmitter as the TX progresses, true means quit
+    bool OnTxProgress(uint64_t msSinceStart)
+    {
+        bool retVal = false;
+
+        txRecord_.durationMs = msSinceStart;
+
+        if (policy_.quitAfterMs && msSinceStart >= policy_.quitAfterMs)
+        {
+            txRecord_.quitReason = "time limit";
+            retVal = true;
+        }
+        else if (msSinceStart - msAtLastPolicyCheck_ >= POLICY_CHECK_INTERVAL_MS)
+        {
+            msAtLastPolicyCheck_ = msSinceStart;
+
+            uint16_t vccMv = ADC::GetMilliVoltsVCC();
+            int16_t  tempC = (int16_t)TempSensorInternal::GetTempC();
+
+            txRecord_.vccMinMv = min(txRecord_.vccMinMv, vccMv);
+
+            if (txRecord_.sampleCount < TxRecord::SAMPLE_COUNT_MAX &&
+                msSinceStart >= (uint64_t)txRecord_.sampleCount * RECORD_SAMPLE_INTERVAL_MS)
+            {
+                txRecord_.vccMvList[txRecord_.sampleCount++] = vccMv;
+            }
+
+            if (policy_.minVccMv && vccMv < policy_.minVccMv)
+            {
+                txRecord_.quitReason = "low vcc";
+                retVal = true;
+            }
+            else if (tempC < policy_.minTempC || tempC > policy_.maxTempC)
+            {
+                txRecord_.quitReason = "temperature";
+                retVal = true;
+            }
+        }
+
+        if (retVal)
+        {
+            Log("WSPR quitting early (", txRecord_.quitReason, ") - ", Commas(msSinceStart), " ms elapsed");
+        }
+
+        return retVal;
+    }
+
+    void PrintTxPolicy()
+    {
+        Log("TX policy:");
+        Log("  quitAfterMs: ", Commas(policy_.quitAfterMs));
+        Log("  minVccMv   : ", Commas(policy_.minVccMv));
+        Log("  tempC      : ", policy_.minTempC, " to ", policy_.maxTempC);
+        Log("  skipped    : ", skipCount_);
+
+        for (uint8_t i = 0; i < recordCount_; ++i)
+        {
+            const TxRecord &r = recordList_[i];
+
+            string curve;
+            for (uint8_t j = 0; j < r.sampleCount; ++j)
+            {
+                curve += (j ? " " : "") + to_string(r.vccMvList[j]);
+            }
+
+            Log("- ", r.tempStartC, "C, ", Commas(r.durationMs), " ms, vcc ", r.vccStartMv, " min ", r.vccMinMv,
+                r.quitReason[0] ? ", quit: " : "", r.quitReason, " [", curve, "]");
+        }
+    }
+
+
 private:
 
 
@@ -277,29 +711,73 @@ private:
             if (quitMs == 0)
             {
                 Log("WSPR quitms reset, will not quit early");
-
-                wsprMessageTransmitter_.SetQuitEarlyFunction([](uint64_t msSinceStart){
-                    return false;
-                });
             }
             else
             {
                 Log("WSPR quitms set, will quit after ", Commas(quitMs), " ms");
+            }
 
-                wsprMessageTransmitter_.SetQuitEarlyFunction([=](uint64_t msSinceStart){
-                    bool retVal = false;
+            policy_.quitAfterMs = quitMs;
+        }, { .argCount = 1, .help = "quit wspr tx <ms> after tx start, 0 to clear"});
 
-                    if (msSinceStart >= quitMs)
-                    {
-                        retVal = true;
+        Shell::AddCommand("app.wspr.policy", [this](vector<string> argList){
+            if (argList.size() >= 1) { policy_.minVccMv = (uint16_t)atoi(argList[0].c_str()); }
+            if (argList.size() >= 2) { policy_.minTempC = (int16_t)atoi(argList[1].c_str());  }
+            if (argList.size() >= 3) { policy_.maxTempC = (int16_t)atoi(argList[2].c_str());  }
 
-                        Log("WSPR quitting early - ", Commas(msSinceStart), " ms elapsed, limit ", Commas(quitMs), " ms");
-                    }
+            if (argList.size() >= 1)
+            {
+                SaveTxPolicy();
+            }
+
+            PrintTxPolicy();
+        }, { .argCount = -1, .help = "tx policy [minVccMv [minTempC [maxTempC]]], kept in flash, shows tx curves"});
 
-                    return retVal;
-                });
+        Shell::AddCommand("app.tx.plan", [this](vector<string> argList){
+            if (argList.size() >= 2 && argList[0] == "set")
+            {
+                string err;
+                if (txPlan_.Set(argList[1], err) && txPlan_.Save())
+                {
+                    Log("TX plan saved: ", txPlan_.ToString());
+                }
+                else
+                {
+                    Log("ERR: ", err);
+                }
             }
-        }, { .argCount = 1, .help = "quit wspr tx <ms> after tx start, 0 to clear"});
+            else if (argList.size() >= 1 && argList[0] == "del")
+            {
+                txPlan_.Delete();
+                Log("TX plan deleted");
+            }
+            else
+            {
+                txPlan_.Load();
+                Log("TX plan: \"", txPlan_.ToString(), "\"");
+            }
+        }, { .argCount = -1, .help = "tx plan <show/del/set band:channel,...,hop=0/1>"});
+
+        Shell::AddCommand("app.tx.hop", [this](vector<string> argList){
+            string id13 = argList.size() >= 1 ? argList[0] : GetChannelDetails().id13;
+
+            Log("Lane hop offsets for ", id13, " by UTC window start");
+
+            TxLaneHop hop;
+            hop.Build(id13);
+
+            for (uint8_t hour = 0; hour < 24; ++hour)
+            {
+                string line = StrUtl::PadLeft(hour, '0', 2) + ":";
+                for (uint8_t minute = 0; minute < 60; minute += 10)
+                {
+                    int8_t offsetHz = hop.GetOffsetHz(TxLaneHop::GetWindowIdx(hour, minute));
+
+                    line += StrUtl::PadLeft((offsetHz > 0 ? "+" : "") + to_string(offsetHz), ' ', 5);
+                }
+                Log(line);
+            }
+        }, { .argCount = -1, .help = "show lane hop offsets [id13]"});
 
         Shell::AddCommand("app.wspr.send", [this](vector<string> argList){
             string callsign = argList[0];
@@ -350,6 +828,7 @@ private:
             cfg_.band       = band;
             cfg_.channel    = channel;
             cfg_.correction = correction;
+            flightCfgLocked_ = false;
 
             SetupTransmitterForCalibration();
         });
@@ -360,6 +839,42 @@ private:
             SetupTransmitterForFlight();
         });
 
+        JSONMsgRouter::RegisterHandler("REQ_GET_TX_PLAN", [this](auto &in, auto &out){
+            out["type"] = "REP_GET_TX_PLAN";
+
+            txPlan_.Load();
+            out["plan"] = txPlan_.ToString();
+        });
+
+        // empty plan deletes it
+        JSONMsgRouter::RegisterHandler("REQ_SET_TX_PLAN", [this](auto &in, auto &out){
+            out["type"] = "REP_SET_TX_PLAN";
+
+            string plan = (const char *)in["plan"];
+
+            Log("REQ_SET_TX_PLAN: ", plan);
+
+            bool ok = true;
+            string err;
+
+            if (plan == "")
+            {
+                txPlan_.Delete();
+            }
+            else if (txPlan_.Set(plan, err) == false)
+            {
+                ok = false;
+            }
+            else if (txPlan_.Save() == false)
+            {
+                ok = false;
+                err = "Could not store to flash";
+            }
+
+            out["ok"]  = ok;
+            out["err"] = err;
+        });
+
         JSONMsgRouter::RegisterHandler("REQ_WSPR_SEND", [this](auto &in, auto &out){
             out["type"] = "REP_WSPR_SEND";
 
@@ -379,6 +894,12 @@ private:
 private:
 
     Configuration cfg_;
+    TxPlan txPlan_;
+    vector<TxPlan::Entry>                  flightEntryList_;
+    vector<WsprChannelMap::ChannelDetails> flightCdList_;
+    uint8_t flightCdIdx_ = 0;
+    vector<TxLaneHop> flightHopList_;
+    bool flightCfgLocked_ = false;
 
     Pin pinTxLoadSwitchOnOff_{ 28, Pin::Type::OUTPUT, 1 };
 
@@ -386,4 +907,11 @@ private:
     bool on_ = false;
 
     WSPRMessageTransmitter wsprMessageTransmitter_;
+
+    TxPolicy policy_;
+    TxRecord txRecord_;
+    array<TxRecord, RECORD_COUNT_MAX> recordList_;
+    uint8_t  recordCount_ = 0;
+    uint64_t msAtLastPolicyCheck_ = 0;
+    uint32_t skipCount_ = 0;
 };
\ No newline at end of file
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "Log.h"
+#include "Utl.h"
+
+#include <cmath>
+#include <cstdint>
+using namespace std;
+
+
+// Estimates how fast the system clock runs relative to GPS time, from the
+// error seen at each GPS time sync, so that time can be projected
+// accurately between syncs (eg when coasting).
+//
+// Each sync reports how far the time carried since the last sync was off,
+// over how long. That gives a rate sample, which is smoothed into the
+// estimate. Samples from short intervals (poor resolution) and implausible
+// rates (time shifted by hand, midnight rollover, test fakery) are
+// ignored.
+class TimeDiscipline
+{
+public:
+
+    // offsetUs is the correct time less the time carried from the last
+    // sync, elapsedUs is the system time between the syncs
+    void OnSync(int64_t offsetUs, uint64_t elapsedUs)
+    {
+        if (enabled_ == false || elapsedUs < ELAPSED_MIN_US)
+        {
+            return;
+        }
+
+        // a clock running fast falls behind the correct time, the offset
+        // is negative
+        double ratePpm = -(double)offsetUs * 1'000'000.0 / (double)elapsedUs;
+
+        if (fabs(ratePpm) > RATE_MAX_PPM)
+        {
+            Log("    Time drift sample rejected: ", ToString(ratePpm, 2), " ppm");
+            return;
+        }
+
+        if (sampleCount_ == 0)
+        {
+            ratePpm_ = ratePpm;
+        }
+        else
+        {
+            ratePpm_ += (ratePpm - ratePpm_) * EWMA_ALPHA;
+        }
+
+        if (sampleCount_ < UINT8_MAX)
+        {
+            ++sampleCount_;
+        }
+
+        Log("    Time drift: sample ", ToString(ratePpm, 2), " ppm, estimate ", ToString(ratePpm_, 2), " ppm (", sampleCount_, " samples)");
+    }
+
+    bool IsTrusted() const
+    {
+        return enabled_ && sampleCount_ >= SAMPLE_COUNT_TO_TRUST;
+    }
+
+    double GetRatePpm() const
+    {
+        return ratePpm_;
+    }
+
+    // How far ahead of the correct time the carried time has got after
+    // elapsedUs since the last sync (negative if behind)
+    int64_t GetDriftUs(uint64_t elapsedUs) const
+    {
+        int64_t retVal = 0;
+
+        if (IsTrusted())
+        {
+            retVal = (int64_t)llround((double)elapsedUs * ratePpm_ / 1'000'000.0);
+        }
+
+        return retVal;
+    }
+
+    // How long in system time a duration of correct time takes
+    uint64_t ToSystemDurationUs(uint64_t durationUs) const
+    {
+        uint64_t retVal = durationUs;
+
+        if (IsTrusted())
+        {
+            retVal = (uint64_t)llround((double)durationUs * (1.0 + ratePpm_ / 1'000'000.0));
+        }
+
+        return retVal;
+    }
+
+    void SetEnabled(bool enabled)
+    {
+        enabled_ = enabled;
+    }
+
+    void Reset()
+    {
+        ratePpm_     = 0;
+        sampleCount_ = 0;
+    }
+
+    void Print() const
+    {
+        Log("Time discipline (", enabled_ ? "enabled" : "disabled", "): ",
+            ToString(ratePpm_, 2), " ppm, ", sampleCount_, " samples, ",
+            IsTrusted() ? "in use" : "not in use");
+    }
+
+
+private:
+
+    static const uint64_t ELAPSED_MIN_US        = 60 * 1'000 * 1'000;
+    static const uint8_t  SAMPLE_COUNT_TO_TRUST = 2;
+
+    static constexpr double RATE_MAX_PPM = 200;
+    static constexpr double EWMA_ALPHA   = 0.3;
+
+    bool enabled_ = true;
+
+    double  ratePpm_     = 0;
+    uint8_t sampleCount_ = 0;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+using namespace std;
+
+
+// Deterministic audio offset hopping within a channel's lane.
+//
+// Every channel transmits on a fixed lane frequency, so two trackers
+// sharing a channel collide in every window. With hopping, each 10 minute
+// window of the UTC day gets its own offset from the lane frequency,
+// picked by hashing the id13 and the window index. A receiver knowing the
+// id13 can work out the offset for any window.
+//
+// Offsets stay well inside the lane so receivers matching signals to
+// lanes still see the channel they expect.
+//
+// The offsets for the day are computed once per flight, so looking one
+// up for a window is a table read.
+class TxLaneHop
+{
+public:
+
+    static const uint8_t WINDOW_COUNT   = 144;   // 10 minute windows per day
+    static const uint8_t STEP_HZ        = 4;
+    static const uint8_t STEP_COUNT     = 7;     // -12Hz to +12Hz
+
+    void Build(const string &id13)
+    {
+        for (uint8_t i = 0; i < WINDOW_COUNT; ++i)
+        {
+            offsetHzList_[i] = CalculateOffsetHz(id13, i);
+        }
+    }
+
+    int8_t GetOffsetHz(uint8_t windowIdx) const
+    {
+        return offsetHzList_[windowIdx % WINDOW_COUNT];
+    }
+
+    static uint8_t GetWindowIdx(uint8_t hour, uint8_t minute)
+    {
+        return (uint8_t)(((hour % 24) * 60 + (minute % 60)) / 10);
+    }
+
+    // FNV-1a over the id13 characters and window index, folded onto the
+    // offset steps
+    static int8_t CalculateOffsetHz(const string &id13, uint8_t windowIdx)
+    {
+        uint32_t hash = 2166136261u;
+
+        auto Mix = [&](uint8_t b){
+            hash ^= b;
+            hash *= 16777619u;
+        };
+
+        for (char c : id13)
+        {
+            Mix((uint8_t)c);
+        }
+        Mix(windowIdx);
+
+        int8_t step = (int8_t)(hash % STEP_COUNT) - (int8_t)(STEP_COUNT / 2);
+
+        return (int8_t)(step * STEP_HZ);
+    }
+
+
+private:
+
+    array<int8_t, WINDOW_COUNT> offsetHzList_ = {};
+};
@@ -0,0 +1,202 @@
+#pragma once
+
+#include "FilesystemLittleFS.h"
+#include "Log.h"
+#include "Utl.h"
+#include "WsprEncodedDynamic.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+using namespace std;
+
+
+// A list of (band, channel) pairs to rotate through, one per window.
+//
+// Kept in its own versioned file rather than in the Configuration flash
+// state, so that devices with a stored configuration keep it across an
+// upgrade, and a device with no plan behaves exactly as before (the
+// configured band and channel only).
+//
+// Lane hopping (see TxLaneHop) is an option of the plan, given as a
+// "hop=1" entry, and applies whether or not any (band, channel) entries
+// are given.
+//
+// Stored as text, eg "v1 20m:414 40m:123 hop=1".
+class TxPlan
+{
+private:
+
+    inline static const char *FILE_NAME    = "txplan.txt";
+    inline static const char *FILE_VERSION = "v1";
+
+public:
+
+    static const uint8_t ENTRY_COUNT_MAX = 4;
+
+    struct Entry
+    {
+        string   band;
+        uint16_t channel = 0;
+    };
+
+
+public:
+
+    // Returns true if there are (band, channel) entries
+    bool Load()
+    {
+        entryList_.clear();
+        hop_ = false;
+
+        string data = FilesystemLittleFS::Read(FILE_NAME);
+        vector<string> partList = Split(data, " ");
+
+        bool retVal = false;
+
+        if (partList.size() >= 2 && partList[0] == FILE_VERSION)
+        {
+            string err;
+            retVal = ParseEntryList(vector<string>(partList.begin() + 1, partList.end()), entryList_, hop_, err);
+
+            if (retVal == false)
+            {
+                Log("ERR: TX plan: ", err);
+                entryList_.clear();
+                hop_ = false;
+            }
+
+            retVal = retVal && entryList_.size();
+        }
+
+        return retVal;
+    }
+
+    bool Save() const
+    {
+        bool retVal = FilesystemLittleFS::Write(FILE_NAME, string{FILE_VERSION} + " " + ToString());
+
+        if (retVal == false)
+        {
+            Log("ERR: TX plan: could not save");
+        }
+
+        return retVal;
+    }
+
+    void Delete()
+    {
+        entryList_.clear();
+        hop_ = false;
+
+        FilesystemLittleFS::Remove(FILE_NAME);
+    }
+
+    // Parses space or comma separated "band:channel" and "hop=0/1" entries
+    bool Set(const string &str, string &err)
+    {
+        string strSpaced = str;
+        replace(strSpaced.begin(), strSpaced.end(), ',', ' ');
+
+        vector<Entry> entryList;
+        bool hop = false;
+        bool retVal = ParseEntryList(Split(strSpaced, " "), entryList, hop, err);
+
+        if (retVal)
+        {
+            entryList_ = entryList;
+            hop_ = hop;
+        }
+
+        return retVal;
+    }
+
+    const vector<Entry> &GetEntryList() const
+    {
+        return entryList_;
+    }
+
+    bool GetHop() const
+    {
+        return hop_;
+    }
+
+    string ToString() const
+    {
+        string retVal;
+
+        string sep;
+        for (const auto &e : entryList_)
+        {
+            retVal += sep + e.band + ":" + to_string(e.channel);
+            sep = " ";
+        }
+
+        if (hop_)
+        {
+            retVal += sep + "hop=1";
+        }
+
+        return retVal;
+    }
+
+
+private:
+
+    static bool ParseEntryList(const vector<string> &partList, vector<Entry> &entryList, bool &hop, string &err)
+    {
+        for (const auto &part : partList)
+        {
+            if (part == "")
+            {
+                continue;
+            }
+
+            if (part == "hop=1" || part == "hop=0")
+            {
+                hop = part == "hop=1";
+                continue;
+            }
+
+            vector<string> bandChannel = Split(part, ":");
+
+            if (bandChannel.size() != 2)
+            {
+                err = "Invalid entry \"" + part + "\"";
+                return false;
+            }
+
+            Entry e;
+            e.band    = bandChannel[0];
+            e.channel = (uint16_t)atoi(bandChannel[1].c_str());
+
+            if (e.band != Wspr::GetDefaultBandIfNotValid(e.band.c_str()))
+            {
+                err = "Invalid band \"" + e.band + "\"";
+                return false;
+            }
+
+            if (e.channel != WsprChannelMap::GetDefaultChannelIfNotValid(e.channel))
+            {
+                err = "Invalid channel \"" + bandChannel[1] + "\"";
+                return false;
+            }
+
+            if (entryList.size() == ENTRY_COUNT_MAX)
+            {
+                err = "Too many entries, max " + to_string(ENTRY_COUNT_MAX);
+                return false;
+            }
+
+            entryList.push_back(e);
+        }
+
+        return true;
+    }
+
+
+private:
+
+    vector<Entry> entryList_;
+    bool hop_ = false;
+};
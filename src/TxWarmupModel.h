@@ -0,0 +1,337 @@
+#pragma once
+
+#include "FilesystemLittleFS.h"
+#include "Log.h"
+#include "Utl.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+using namespace std;
+
+
+// Learns how long the transmitter needs to warm up, by temperature.
+//
+// The oscillator frequency can't be measured on board, so the board
+// temperature after the radio is powered is used as a stand-in. It is
+// the RP2040 die temperature, which only loosely follows the synth and
+// its reference, so the model is off by default.
+//
+// During each warmup the temperature is sampled once a second. Only a
+// warmup in which the temperature drifted and then settled says how long
+// settling took. One in which it never moved says nothing, and is not
+// learned from, so a board which is already stable doesn't teach the
+// model to cut warmup short. One which drifted but ended before settling
+// only says more time was needed, so the bucket is pushed up.
+//
+// A bucket is trusted once it has a few observations, otherwise the full
+// default warmup is used.
+//
+// The enable flag and what was learned are kept in flash, so they last
+// across reboots. What is learned during a warmup is only written by
+// Flush(), called once the radio is off, never during a transmission.
+//
+// Stored as text, a version and enable line, then one "bucket avgMs count"
+// line per bucket with observations, eg "v1 enabled=1\n7 14250 4".
+class TxWarmupModel
+{
+private:
+
+    inline static const char *FILE_NAME    = "txwarmup.txt";
+    inline static const char *FILE_VERSION = "v1";
+
+public:
+
+    void Load()
+    {
+        enabled_ = false;
+        bucketList_ = {};
+        dirty_ = false;
+
+        vector<string> lineList = Split(FilesystemLittleFS::Read(FILE_NAME), "\n");
+
+        if (lineList.size() >= 1 && lineList[0].rfind(string{FILE_VERSION} + " ", 0) == 0)
+        {
+            enabled_ = lineList[0] == string{FILE_VERSION} + " enabled=1";
+
+            for (size_t i = 1; i < lineList.size(); ++i)
+            {
+                vector<string> partList = Split(lineList[i], " ");
+
+                if (partList.size() == 3)
+                {
+                    int idx   = atoi(partList[0].c_str());
+                    int count = atoi(partList[2].c_str());
+
+                    if (idx >= 0 && idx < BUCKET_COUNT && count > 0 && count <= UINT8_MAX)
+                    {
+                        bucketList_[idx].avgUs = atof(partList[1].c_str()) * 1'000;
+                        bucketList_[idx].count = (uint8_t)count;
+                    }
+                }
+            }
+        }
+    }
+
+    // Write to flash if anything was learned since last time
+    bool Flush()
+    {
+        bool retVal = true;
+
+        if (dirty_)
+        {
+            retVal = Save();
+        }
+
+        return retVal;
+    }
+
+    void OnWarmupStart(uint64_t timeNowUs, double tempC)
+    {
+        warmupActive_ = true;
+        timeAtStartUs_ = timeNowUs;
+        tempAtStartC_  = tempC;
+
+        sampleCount_    = 0;
+        drifted_        = false;
+        settledAfterUs_ = 0;
+
+        OnSample(timeNowUs, tempC);
+    }
+
+    // Call about once a second during warmup
+    void OnSample(uint64_t timeNowUs, double tempC)
+    {
+        if (warmupActive_ == false || settledAfterUs_ != 0)
+        {
+            return;
+        }
+
+        sampleList_[sampleCount_ % SAMPLE_LIST_LEN] = tempC;
+        ++sampleCount_;
+
+        // nothing to settle from until the temperature has moved
+        if (fabs(tempC - tempAtStartC_) >= DRIFT_MIN_C)
+        {
+            drifted_ = true;
+        }
+
+        // settled when the temperature no longer moves across the window
+        if (drifted_ && sampleCount_ >= SAMPLE_LIST_LEN)
+        {
+            auto [itMin, itMax] = minmax_element(sampleList_.begin(), sampleList_.end());
+
+            // settling is judged to have happened at the start of the
+            // window which showed it, which must be after the start
+            uint64_t elapsedUs = timeNowUs - timeAtStartUs_;
+            uint64_t windowUs  = (SAMPLE_LIST_LEN - 1) * 1'000'000ULL;
+
+            if (*itMax - *itMin <= SETTLED_RANGE_C && elapsedUs > windowUs)
+            {
+                settledAfterUs_ = elapsedUs - windowUs;
+            }
+        }
+    }
+
+    void OnWarmupEnd(uint64_t timeNowUs)
+    {
+        if (warmupActive_ == false)
+        {
+            return;
+        }
+
+        warmupActive_ = false;
+
+        uint64_t warmupUs = timeNowUs - timeAtStartUs_;
+
+        if (drifted_ == false)
+        {
+            Log("TX warmup at ", (int)round(tempAtStartC_), "C: no drift seen in ",
+                Commas(warmupUs / 1'000), " ms, nothing learned");
+
+            return;
+        }
+
+        Bucket &b = GetBucket(tempAtStartC_);
+
+        double observedUs = 0;
+        if (settledAfterUs_)
+        {
+            observedUs = settledAfterUs_;
+        }
+        else
+        {
+            // censored, needed at least this long, and some more
+            observedUs = warmupUs + UNSETTLED_PENALTY_US;
+        }
+
+        if (b.count == 0)
+        {
+            b.avgUs = observedUs;
+        }
+        else
+        {
+            b.avgUs += (observedUs - b.avgUs) * EWMA_ALPHA;
+        }
+
+        if (b.count < UINT8_MAX)
+        {
+            ++b.count;
+        }
+
+        dirty_ = true;
+
+        Log("TX warmup at ", (int)round(tempAtStartC_), "C: ",
+            settledAfterUs_ ? "settled after " : "did not settle in ",
+            Commas((settledAfterUs_ ? settledAfterUs_ : warmupUs) / 1'000), " ms, ",
+            "learned ", Commas((uint64_t)b.avgUs / 1'000), " ms (", b.count, " obs)");
+    }
+
+    // Radio stopped without transmitting, nothing learned
+    void OnWarmupAbandon()
+    {
+        warmupActive_ = false;
+    }
+
+    uint64_t GetWarmupDurationUs(double tempC) const
+    {
+        uint64_t retVal = DURATION_DEFAULT_US;
+
+        const Bucket &b = GetBucket(tempC);
+
+        if (enabled_ && b.count >= OBSERVATIONS_TO_TRUST)
+        {
+            retVal = (uint64_t)b.avgUs + MARGIN_US;
+
+            retVal = clamp(retVal, DURATION_MIN_US, DURATION_DEFAULT_US);
+        }
+
+        return retVal;
+    }
+
+    void SetEnabled(bool enabled)
+    {
+        enabled_ = enabled;
+
+        Save();
+    }
+
+    // Forget what was learned, keeps the enable flag
+    void Clear()
+    {
+        bucketList_ = {};
+
+        Save();
+    }
+
+    void Print(double tempCNow) const
+    {
+        Log("TX warmup model (", enabled_ ? "enabled" : "disabled", ")");
+        for (uint8_t i = 0; i < BUCKET_COUNT; ++i)
+        {
+            const Bucket &b = bucketList_[i];
+
+            if (b.count)
+            {
+                int lowC = BUCKET_LOW_C + i * BUCKET_WIDTH_C;
+
+                Log("- ", lowC, "C to ", lowC + BUCKET_WIDTH_C, "C: ", Commas((uint64_t)b.avgUs / 1'000), " ms (", b.count, " obs)");
+            }
+        }
+        Log("Warmup now at ", (int)round(tempCNow), "C: ", Commas(GetWarmupDurationUs(tempCNow) / 1'000), " ms");
+    }
+
+
+private:
+
+    bool Save()
+    {
+        string data = string{FILE_VERSION} + (enabled_ ? " enabled=1" : " enabled=0") + "\n";
+
+        for (uint8_t i = 0; i < BUCKET_COUNT; ++i)
+        {
+            const Bucket &b = bucketList_[i];
+
+            if (b.count)
+            {
+                data += to_string(i) + " " + to_string((uint64_t)b.avgUs / 1'000) + " " + to_string(b.count) + "\n";
+            }
+        }
+
+        bool retVal = FilesystemLittleFS::Write(FILE_NAME, data);
+
+        if (retVal)
+        {
+            dirty_ = false;
+        }
+        else
+        {
+            Log("ERR: TX warmup model: could not save");
+        }
+
+        return retVal;
+    }
+
+    struct Bucket
+    {
+        double  avgUs = 0;
+        uint8_t count = 0;
+    };
+
+    static const int     BUCKET_LOW_C   = -60;
+    static const int     BUCKET_WIDTH_C = 10;
+    static const uint8_t BUCKET_COUNT   = 11;   // up to +50C
+
+    Bucket &GetBucket(double tempC)
+    {
+        return bucketList_[GetBucketIdx(tempC)];
+    }
+
+    const Bucket &GetBucket(double tempC) const
+    {
+        return bucketList_[GetBucketIdx(tempC)];
+    }
+
+    static uint8_t GetBucketIdx(double tempC)
+    {
+        int idx = (int)floor((tempC - BUCKET_LOW_C) / BUCKET_WIDTH_C);
+
+        return (uint8_t)clamp(idx, 0, BUCKET_COUNT - 1);
+    }
+
+
+private:
+
+    static const uint64_t DURATION_DEFAULT_US   = 30 * 1'000 * 1'000;
+    static const uint64_t DURATION_MIN_US       =  8 * 1'000 * 1'000;
+    static const uint64_t MARGIN_US             =  3 * 1'000 * 1'000;
+    static const uint64_t UNSETTLED_PENALTY_US  =  5 * 1'000 * 1'000;
+    static const uint8_t  OBSERVATIONS_TO_TRUST = 3;
+
+    static constexpr double EWMA_ALPHA = 0.25;
+
+    // the internal sensor resolves ~0.5C, so allow a step of noise
+    static const uint8_t SAMPLE_LIST_LEN = 5;
+    static constexpr double SETTLED_RANGE_C = 1.0;
+
+    // a move of more than noise from where the warmup started
+    static constexpr double DRIFT_MIN_C = 2.0;
+
+    array<Bucket, BUCKET_COUNT> bucketList_;
+
+    bool enabled_ = false;
+    bool dirty_   = false;
+
+    bool     warmupActive_  = false;
+    uint64_t timeAtStartUs_ = 0;
+    double   tempAtStartC_  = 0;
+
+    array<double, SAMPLE_LIST_LEN> sampleList_ = {};
+    uint32_t sampleCount_    = 0;
+    bool     drifted_        = false;
+    uint64_t settledAfterUs_ = 0;
+};
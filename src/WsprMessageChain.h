@@ -0,0 +1,141 @@
+#pragma once
+
+#include "Log.h"
+#include "WsprEncodedDynamic.h"
+
+#include <array>
+#include <string>
+#include <utility>
+#include <vector>
+using namespace std;
+
+
+// A logical telemetry record too big for one extended telemetry message,
+// carried by several messages sent in sequential slots.
+//
+// Fields are laid out in definition order, each going into the current
+// message until it is full, then into the next. Every message starts
+// with a reassembly header so that a receiver can put the record back
+// together and know whether it has all of it:
+// - ChainSeqIndex : 0-based position of this message in the record
+// - ChainLenCount : number of messages in the record
+template <typename MsgT, uint8_t MSG_COUNT_MAX = 4>
+class WsprMessageChain
+{
+public:
+
+    inline static const char *FIELD_SEQ = "ChainSeqIndex";
+    inline static const char *FIELD_LEN = "ChainLenCount";
+
+    void ResetEverything()
+    {
+        msgCount_ = 0;
+        fieldMsgIdxList_.clear();
+        err_ = "";
+    }
+
+    bool DefineField(const char *name, double lowValue, double highValue, double stepSize)
+    {
+        bool retVal = false;
+
+        if (msgCount_ == 0)
+        {
+            StartMsg();
+        }
+
+        if (msgList_[msgCount_ - 1].DefineField(name, lowValue, highValue, stepSize))
+        {
+            retVal = true;
+        }
+        else if (msgCount_ == MSG_COUNT_MAX)
+        {
+            err_ = "Chain full at field " + string{name};
+        }
+        else
+        {
+            // didn't fit, move to a new message
+            StartMsg();
+
+            if (msgList_[msgCount_ - 1].DefineField(name, lowValue, highValue, stepSize))
+            {
+                retVal = true;
+            }
+            else
+            {
+                // won't fit anywhere, no use for the new message
+                --msgCount_;
+
+                err_ = msgList_[msgCount_].GetDefineFieldErr();
+            }
+        }
+
+        if (retVal)
+        {
+            fieldMsgIdxList_.push_back({ name, msgCount_ - 1 });
+        }
+
+        return retVal;
+    }
+
+    string GetDefineFieldErr() const
+    {
+        return err_;
+    }
+
+    bool Set(const char *name, double value)
+    {
+        bool retVal = false;
+
+        for (const auto &[fieldName, idx] : fieldMsgIdxList_)
+        {
+            if (fieldName == name)
+            {
+                retVal = msgList_[idx].Set(name, value);
+
+                break;
+            }
+        }
+
+        return retVal;
+    }
+
+    uint8_t GetMsgCount() const
+    {
+        return msgCount_;
+    }
+
+    // Returns the message at seq with its header filled out, ready to
+    // have its id13 and header slot set, then be encoded.
+    MsgT &GetMsg(uint8_t seq)
+    {
+        MsgT &msg = msgList_[seq < msgCount_ ? seq : 0];
+
+        msg.Set(FIELD_SEQ, seq);
+        msg.Set(FIELD_LEN, msgCount_);
+
+        return msg;
+    }
+
+
+private:
+
+    void StartMsg()
+    {
+        MsgT &msg = msgList_[msgCount_];
+        ++msgCount_;
+
+        msg.ResetEverything();
+        msg.DefineField(FIELD_SEQ, 0, MSG_COUNT_MAX - 1, 1);
+        msg.DefineField(FIELD_LEN, 1, MSG_COUNT_MAX,     1);
+    }
+
+
+private:
+
+    array<MsgT, MSG_COUNT_MAX> msgList_;
+    uint8_t msgCount_ = 0;
+
+    vector<pair<string, uint8_t>> fieldMsgIdxList_;
+
+    string err_;
+};
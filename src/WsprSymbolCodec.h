@@ -0,0 +1,313 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+using namespace std;
+
+
+// Reference WSPR Type 1 channel symbol codec.
+//
+// Turns a callsign, grid4 and power into the 162 4-FSK symbols which go
+// over the air, and back again, independently of the transmitter library.
+// Used by the host tests (test/) to check channel symbols against those
+// known to go over the air, and that messages survive the trip through
+// the symbol stream.
+//
+// Decoding assumes a noise-free stream (the convolutional code is undone
+// bit by bit, not searched), and fails if any parity bit disagrees.
+class WsprSymbolCodec
+{
+public:
+
+    static const uint8_t SYMBOL_COUNT = 162;
+
+    using SymbolList = array<uint8_t, SYMBOL_COUNT>;
+
+
+public:
+
+    static bool Encode(const string &callsign, const string &grid4, uint8_t powerDbm, SymbolList &symbolList)
+    {
+        uint32_t n = 0;
+        uint32_t m = 0;
+
+        if (PackCallsign(callsign, n) == false || PackGridPower(grid4, powerDbm, m) == false)
+        {
+            return false;
+        }
+
+        // 50 bits of message, msb first, then 31 zero bits to flush
+        array<uint8_t, 11> byteList = {};
+        byteList[0] = (uint8_t)(n >> 20);
+        byteList[1] = (uint8_t)(n >> 12);
+        byteList[2] = (uint8_t)(n >> 4);
+        byteList[3] = (uint8_t)(((n & 0x0F) << 4) | ((m >> 18) & 0x0F));
+        byteList[4] = (uint8_t)(m >> 10);
+        byteList[5] = (uint8_t)(m >> 2);
+        byteList[6] = (uint8_t)((m & 0x03) << 6);
+
+        // rate 1/2, K=32 convolutional code
+        SymbolList bitList;
+        uint32_t reg = 0;
+        uint8_t  idx = 0;
+        for (uint8_t i = 0; i < SYMBOL_COUNT / 2; ++i)
+        {
+            uint8_t bit = (byteList[i / 8] >> (7 - (i % 8))) & 1;
+
+            reg = (reg << 1) | bit;
+
+            bitList[idx++] = Parity(reg & POLY_0);
+            bitList[idx++] = Parity(reg & POLY_1);
+        }
+
+        // interleave by bit-reversed address, then merge in the sync
+        idx = 0;
+        for (uint16_t i = 0; i < 256; ++i)
+        {
+            uint8_t j = BitReverse((uint8_t)i);
+
+            if (j < SYMBOL_COUNT)
+            {
+                symbolList[j] = (uint8_t)(SYNC_LIST[j] + 2 * bitList[idx++]);
+            }
+        }
+
+        return true;
+    }
+
+    static bool Decode(const SymbolList &symbolList, string &callsign, string &grid4, uint8_t &powerDbm)
+    {
+        // strip and check the sync, then undo the interleave
+        SymbolList bitList;
+        uint8_t idx = 0;
+        for (uint16_t i = 0; i < 256; ++i)
+        {
+            uint8_t j = BitReverse((uint8_t)i);
+
+            if (j < SYMBOL_COUNT)
+            {
+                if (symbolList[j] > 3 || (symbolList[j] & 1) != SYNC_LIST[j])
+                {
+                    return false;
+                }
+
+                bitList[idx++] = symbolList[j] >> 1;
+            }
+        }
+
+        // both polynomials tap the newest bit, so each input bit follows
+        // from the first parity bit and the bits already recovered
+        uint64_t msg = 0;
+        uint32_t reg = 0;
+        for (uint8_t i = 0; i < SYMBOL_COUNT / 2; ++i)
+        {
+            uint8_t bit = bitList[i * 2] ^ Parity((reg << 1) & POLY_0);
+
+            reg = (reg << 1) | bit;
+
+            if (Parity(reg & POLY_1) != bitList[i * 2 + 1])
+            {
+                return false;
+            }
+
+            if (i < 50)
+            {
+                msg = (msg << 1) | bit;
+            }
+            else if (bit)
+            {
+                // tail must be zero
+                return false;
+            }
+        }
+
+        uint32_t n = (uint32_t)(msg >> 22);
+        uint32_t m = (uint32_t)(msg & 0x3FFFFF);
+
+        return UnpackCallsign(n, callsign) && UnpackGridPower(m, grid4, powerDbm);
+    }
+
+
+private:
+
+    static bool PackCallsign(const string &callsign, uint32_t &n)
+    {
+        // the digit goes in the third position, pad the front if needed
+        string cs = callsign;
+        if (cs.size() >= 2 && IsDigit(cs[1]) && (cs.size() < 3 || IsDigit(cs[2]) == false))
+        {
+            cs = " " + cs;
+        }
+
+        if (cs.size() < 3 || cs.size() > 6 || IsDigit(cs[2]) == false)
+        {
+            return false;
+        }
+
+        while (cs.size() < 6)
+        {
+            cs += ' ';
+        }
+
+        array<uint8_t, 6> codeList;
+        for (uint8_t i = 0; i < 6; ++i)
+        {
+            if (CharToCode(cs[i], codeList[i]) == false)
+            {
+                return false;
+            }
+        }
+
+        // position 1 is alphanumeric, 2 is a digit, 3-5 are letters or space
+        if (codeList[1] == 36 || codeList[2] > 9)
+        {
+            return false;
+        }
+        for (uint8_t i = 3; i < 6; ++i)
+        {
+            if (codeList[i] < 10)
+            {
+                return false;
+            }
+        }
+
+        n = codeList[0];
+        n = n * 36 + codeList[1];
+        n = n * 10 + codeList[2];
+        n = n * 27 + (codeList[3] - 10);
+        n = n * 27 + (codeList[4] - 10);
+        n = n * 27 + (codeList[5] - 10);
+
+        return true;
+    }
+
+    static bool UnpackCallsign(uint32_t n, string &callsign)
+    {
+        array<uint8_t, 6> codeList;
+        codeList[5] = (uint8_t)(n % 27 + 10); n /= 27;
+        codeList[4] = (uint8_t)(n % 27 + 10); n /= 27;
+        codeList[3] = (uint8_t)(n % 27 + 10); n /= 27;
+        codeList[2] = (uint8_t)(n % 10);      n /= 10;
+        codeList[1] = (uint8_t)(n % 36);      n /= 36;
+        codeList[0] = (uint8_t)n;
+
+        if (codeList[0] > 36)
+        {
+            return false;
+        }
+
+        callsign = "";
+        for (uint8_t code : codeList)
+        {
+            char c = CodeToChar(code);
+
+            if (c != ' ')
+            {
+                callsign += c;
+            }
+        }
+
+        return true;
+    }
+
+    static bool PackGridPower(const string &grid4, uint8_t powerDbm, uint32_t &m)
+    {
+        if (grid4.size() != 4 ||
+            grid4[0] < 'A' || grid4[0] > 'R' || grid4[1] < 'A' || grid4[1] > 'R' ||
+            IsDigit(grid4[2]) == false || IsDigit(grid4[3]) == false ||
+            powerDbm > 60)
+        {
+            return false;
+        }
+
+        m = (179 - 10 * (grid4[0] - 'A') - (grid4[2] - '0')) * 180 + 10 * (grid4[1] - 'A') + (grid4[3] - '0');
+        m = m * 128 + powerDbm + 64;
+
+        return true;
+    }
+
+    static bool UnpackGridPower(uint32_t m, string &grid4, uint8_t &powerDbm)
+    {
+        int power = (int)(m % 128) - 64;
+        m /= 128;
+
+        uint32_t lng = m % 180;
+        uint32_t lat = 179 - m / 180;
+
+        if (power < 0 || power > 60 || m / 180 > 179 || lat / 10 > 17 || lng / 10 > 17)
+        {
+            return false;
+        }
+
+        grid4 = "";
+        grid4 += (char)('A' + lat / 10);
+        grid4 += (char)('A' + lng / 10);
+        grid4 += (char)('0' + lat % 10);
+        grid4 += (char)('0' + lng % 10);
+
+        powerDbm = (uint8_t)power;
+
+        return true;
+    }
+
+    static bool IsDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    static bool CharToCode(char c, uint8_t &code)
+    {
+        bool retVal = true;
+
+        if      (c >= '0' && c <= '9') { code = (uint8_t)(c - '0');      }
+        else if (c >= 'A' && c <= 'Z') { code = (uint8_t)(c - 'A' + 10); }
+        else if (c >= 'a' && c <= 'z') { code = (uint8_t)(c - 'a' + 10); }
+        else if (c == ' ')             { code = 36;                      }
+        else                           { retVal = false;                 }
+
+        return retVal;
+    }
+
+    static char CodeToChar(uint8_t code)
+    {
+        char retVal = ' ';
+
+        if      (code < 10)  { retVal = (char)('0' + code);      }
+        else if (code < 36)  { retVal = (char)('A' + code - 10); }
+
+        return retVal;
+    }
+
+    static uint8_t Parity(uint32_t val)
+    {
+        return (uint8_t)(__builtin_popcount(val) & 1);
+    }
+
+    static uint8_t BitReverse(uint8_t val)
+    {
+        uint8_t retVal = 0;
+
+        for (uint8_t i = 0; i < 8; ++i)
+        {
+            retVal = (uint8_t)((retVal << 1) | ((val >> i) & 1));
+        }
+
+        return retVal;
+    }
+
+
+private:
+
+    static const uint32_t POLY_0 = 0xF2D05351;
+    static const uint32_t POLY_1 = 0xE4613C47;
+
+    inline static const uint8_t SYNC_LIST[SYMBOL_COUNT] = {
+        1,1,0,0,0,0,0,0,1,0,0,0,1,1,1,0,0,0,1,0,0,1,0,1,1,1,1,0,0,0,0,0,
+        0,0,1,0,0,1,0,1,0,0,0,0,0,0,1,0,1,1,0,0,1,1,0,1,0,0,0,1,1,0,1,0,
+        0,0,0,1,1,0,1,0,1,0,1,0,1,0,0,1,0,0,1,0,1,1,0,0,0,1,1,0,1,0,1,0,
+        0,0,1,0,0,0,0,0,1,0,0,1,0,0,1,1,1,0,1,1,0,0,1,1,0,1,0,0,0,1,1,1,
+        0,0,0,0,0,1,0,1,0,0,1,1,0,0,0,0,0,0,0,1,1,0,1,0,1,1,0,0,0,1,1,0,
+        0,0,
+    };
+};
@@ -0,0 +1,224 @@
+#include "WsprSymbolCodec.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+
+// Host test for WsprSymbolCodec.
+//
+// Checks encoded symbols against a file of known over-the-air symbols,
+// then that regular messages survive the trip through the symbol stream,
+// and that broken streams are turned away.
+//
+// Telemetry messages, as the firmware's encoders produce them, are
+// checked by WsprTelemetryEncodeTest.
+//
+// Usage: WsprSymbolCodecTest <vectors file>
+
+
+static uint32_t failCount = 0;
+
+static void Check(bool ok, const string &what)
+{
+    if (ok == false)
+    {
+        ++failCount;
+        printf("FAIL: %s\n", what.c_str());
+    }
+}
+
+static string ToString(const WsprSymbolCodec::SymbolList &symbolList)
+{
+    string retVal;
+
+    for (uint8_t symbol : symbolList)
+    {
+        retVal += (char)('0' + symbol);
+    }
+
+    return retVal;
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// Known symbols
+/////////////////////////////////////////////////////////////////////
+
+static void TestVectors(const char *fileName)
+{
+    ifstream in(fileName);
+    Check(in.good(), string{"open "} + fileName);
+
+    uint32_t count = 0;
+
+    string line;
+    while (getline(in, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        istringstream ss(line);
+        string callsign;
+        string grid4;
+        int    powerDbm = 0;
+        string symbols;
+        ss >> callsign >> grid4 >> powerDbm >> symbols;
+
+        string name = callsign + " " + grid4 + " " + to_string(powerDbm);
+
+        if (symbols.size() != WsprSymbolCodec::SYMBOL_COUNT)
+        {
+            Check(false, name + ": bad vector line");
+            continue;
+        }
+
+        WsprSymbolCodec::SymbolList symbolList;
+        bool ok = WsprSymbolCodec::Encode(callsign, grid4, (uint8_t)powerDbm, symbolList);
+        Check(ok, name + ": encode");
+        Check(ok && ToString(symbolList) == symbols, name + ": symbols differ from vector");
+
+        // and the known symbols decode to the message
+        for (uint8_t i = 0; i < WsprSymbolCodec::SYMBOL_COUNT; ++i)
+        {
+            symbolList[i] = (uint8_t)(symbols[i] - '0');
+        }
+
+        string  callsignOut;
+        string  grid4Out;
+        uint8_t powerDbmOut = 0;
+        ok = WsprSymbolCodec::Decode(symbolList, callsignOut, grid4Out, powerDbmOut);
+        Check(ok && callsignOut == callsign && grid4Out == grid4 && powerDbmOut == powerDbm, name + ": decode of vector");
+
+        ++count;
+    }
+
+    Check(count != 0, "no vectors");
+    printf("vectors: %u\n", count);
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// Round trip
+/////////////////////////////////////////////////////////////////////
+
+static void TestRoundTrip()
+{
+    struct Msg
+    {
+        const char *callsign;
+        const char *grid4;
+        uint8_t     powerDbm;
+    };
+
+    static const Msg MSG_LIST[] = {
+        // regular type 1
+        { "KD2KDD", "FN20", 23 },
+        { "K1ABC",  "FN42", 37 },
+        { "2E0ABC", "IO91", 10 },
+        { "W1A",    "AA00",  0 },
+        { "VE3XYZ", "RR99", 60 },
+    };
+
+    for (const auto &msg : MSG_LIST)
+    {
+        string name = string{msg.callsign} + " " + msg.grid4 + " " + to_string(msg.powerDbm);
+
+        WsprSymbolCodec::SymbolList symbolList;
+        string  callsign;
+        string  grid4;
+        uint8_t powerDbm = 0;
+
+        bool ok =
+            WsprSymbolCodec::Encode(msg.callsign, msg.grid4, msg.powerDbm, symbolList) &&
+            WsprSymbolCodec::Decode(symbolList, callsign, grid4, powerDbm);
+
+        Check(ok && callsign == msg.callsign && grid4 == msg.grid4 && powerDbm == msg.powerDbm, name + ": round trip");
+    }
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// Bad input
+/////////////////////////////////////////////////////////////////////
+
+static void TestBad()
+{
+    WsprSymbolCodec::SymbolList symbolList;
+
+    Check(WsprSymbolCodec::Encode("ABCDEFG", "FN42", 37, symbolList) == false, "encode: callsign too long");
+    Check(WsprSymbolCodec::Encode("ABCDEF",  "FN42", 37, symbolList) == false, "encode: callsign without digit");
+    Check(WsprSymbolCodec::Encode("K1ABC",   "SN42", 37, symbolList) == false, "encode: grid out of range");
+    Check(WsprSymbolCodec::Encode("K1ABC",   "FN4",  37, symbolList) == false, "encode: grid too short");
+    Check(WsprSymbolCodec::Encode("K1ABC",   "FN42", 61, symbolList) == false, "encode: power out of range");
+
+    WsprSymbolCodec::Encode("K1ABC", "FN42", 37, symbolList);
+
+    string  callsign;
+    string  grid4;
+    uint8_t powerDbm = 0;
+
+    // a flipped data bit shows as a parity error
+    WsprSymbolCodec::SymbolList bad = symbolList;
+    bad[80] ^= 2;
+    Check(WsprSymbolCodec::Decode(bad, callsign, grid4, powerDbm) == false, "decode: data bit flipped");
+
+    // a flipped sync bit is caught before decoding
+    bad = symbolList;
+    bad[0] ^= 1;
+    Check(WsprSymbolCodec::Decode(bad, callsign, grid4, powerDbm) == false, "decode: sync bit flipped");
+
+    bad = symbolList;
+    bad[10] = 4;
+    Check(WsprSymbolCodec::Decode(bad, callsign, grid4, powerDbm) == false, "decode: symbol out of range");
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// Timing, informational
+/////////////////////////////////////////////////////////////////////
+
+static void Bench()
+{
+    static const uint32_t ITERATIONS = 10'000;
+
+    WsprSymbolCodec::SymbolList symbolList;
+    uint32_t sum = 0;
+
+    auto timeStart = chrono::steady_clock::now();
+    for (uint32_t i = 0; i < ITERATIONS; ++i)
+    {
+        WsprSymbolCodec::Encode("KD2KDD", "FN20", (uint8_t)(i % 61), symbolList);
+        sum += symbolList[i % WsprSymbolCodec::SYMBOL_COUNT];
+    }
+    auto timeEnd = chrono::steady_clock::now();
+
+    double usPer = chrono::duration<double, micro>(timeEnd - timeStart).count() / ITERATIONS;
+    printf("encode: %.2f us/msg (host, %u)\n", usPer, sum);
+}
+
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        printf("Usage: %s <vectors file>\n", argv[0]);
+        return 1;
+    }
+
+    TestVectors(argv[1]);
+    TestRoundTrip();
+    TestBad();
+    Bench();
+
+    printf("%s (%u failed)\n", failCount ? "FAIL" : "OK", failCount);
+
+    return failCount ? 1 : 0;
+}
@@ -0,0 +1,197 @@
+#include "WsprEncodedDynamic.h"
+#include "WsprSymbolCodec.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+using namespace std;
+
+
+// Host test for the telemetry encoders the firmware sends with.
+//
+// Messages are filled out and encoded the way SubsystemTx and Application
+// do, then their callsign, grid and power are put through the channel
+// symbols and back, and the user-defined messages are decoded to check
+// every field value comes back.
+//
+// Built against picoinf, only when its sources are present.
+
+
+using MsgUD = WsprMessageTelemetryExtendedUserDefined<29>;
+
+static uint32_t failCount = 0;
+
+static void Check(bool ok, const string &what)
+{
+    if (ok == false)
+    {
+        ++failCount;
+        printf("FAIL: %s\n", what.c_str());
+    }
+}
+
+// Sends the message's callsign, grid and power through the symbol stream
+static bool OverTheAir(const WsprMessageRegularType1 &msg, string &callsign, string &grid4, uint8_t &powerDbm)
+{
+    WsprSymbolCodec::SymbolList symbolList;
+
+    return
+        WsprSymbolCodec::Encode(msg.GetCallsign(), msg.GetGrid4(), msg.GetPowerDbm(), symbolList) &&
+        WsprSymbolCodec::Decode(symbolList, callsign, grid4, powerDbm);
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// Basic telemetry, as SubsystemTx::SendTelemetryBasic
+/////////////////////////////////////////////////////////////////////
+
+static void TestBasic()
+{
+    struct Input
+    {
+        const char *grid56;
+        int32_t     altM;
+        int32_t     tempC;
+        double      voltage;
+        uint32_t    speedKnots;
+        bool        gpsValid;
+    };
+
+    static const Input INPUT_LIST[] = {
+        { "XS", 12060, -40, 3.30, 82, true  },
+        { "AA",     0, -50, 3.00,  0, false },
+        { "XX", 21340,  39, 4.95, 82, true  },
+    };
+
+    for (const auto &in : INPUT_LIST)
+    {
+        WsprMessageTelemetryBasic msg;
+        msg.SetGrid56(in.grid56);
+        msg.SetAltitudeMeters(in.altM);
+        msg.SetTemperatureCelsius(in.tempC);
+        msg.SetVoltageVolts(in.voltage);
+        msg.SetSpeedKnots(in.speedKnots);
+        msg.SetGpsIsValid(in.gpsValid);
+
+        msg.SetId13("Q3");
+        msg.Encode();
+
+        string name = string{"basic "} + msg.GetCallsign() + " " + msg.GetGrid4() + " " + to_string(msg.GetPowerDbm());
+
+        string  callsign;
+        string  grid4;
+        uint8_t powerDbm = 0;
+
+        bool ok = OverTheAir(msg, callsign, grid4, powerDbm);
+
+        Check(ok && callsign == msg.GetCallsign() && grid4 == msg.GetGrid4() && powerDbm == msg.GetPowerDbm(), name + ": round trip");
+    }
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// User defined, as Application sends them
+/////////////////////////////////////////////////////////////////////
+
+static void CheckUserDefined(const string &name, MsgUD &msg)
+{
+    string  callsign;
+    string  grid4;
+    uint8_t powerDbm = 0;
+
+    bool ok = OverTheAir(msg, callsign, grid4, powerDbm);
+    Check(ok, name + ": symbols");
+
+    MsgUD msgDecoded = msg;
+    msgDecoded.Reset();
+    msgDecoded.SetCallsign(callsign.c_str());
+    msgDecoded.SetGrid4(grid4.c_str());
+    msgDecoded.SetPowerDbm(powerDbm);
+
+    Check(ok && msgDecoded.Decode(), name + ": decode");
+
+    for (const auto &fieldName : msg.GetFieldList())
+    {
+        double valueIn  = msg.Get(fieldName.c_str());
+        double valueOut = msgDecoded.Get(fieldName.c_str());
+
+        Check(fabs(valueIn - valueOut) <= 0.0001,
+              name + ": " + fieldName + " " + to_string(valueIn) + " decoded as " + to_string(valueOut));
+    }
+}
+
+static void TestUserDefined()
+{
+    // vendor defined gps data, as SendVendorDefinedGpsData
+    {
+        MsgUD msg;
+        msg.ResetEverything();
+        msg.DefineField("DurBeforeTimeLockSeconds", 0, 1200,  5);
+        msg.DefineField("DurGpsOnSeconds",          0, 1800, 10);
+        msg.DefineField("SatsGPCount",              0,   32,  1);
+        msg.DefineField("SatsBDCount",              0,   45,  1);
+
+        msg.Set("DurBeforeTimeLockSeconds", 35);
+        msg.Set("DurGpsOnSeconds",          1790);
+        msg.Set("SatsGPCount",              11);
+        msg.Set("SatsBDCount",              0);
+
+        msg.SetId13("Q3");
+        msg.SetHdrSlot(0);
+        msg.Encode();
+
+        CheckUserDefined("vendor defined gps", msg);
+    }
+
+    // one type of the sat stats chain, as SendVendorDefinedSatStats
+    {
+        MsgUD msg;
+        msg.ResetEverything();
+        msg.DefineField("SatsInViewGPCount",  0, 40, 1);
+        msg.DefineField("SatsTrackedGPCount", 0, 40, 1);
+        msg.DefineField("Cn0MeanGPDbHz",      0, 60, 2);
+        msg.DefineField("Cn0MaxGPDbHz",       0, 60, 2);
+
+        msg.Set("SatsInViewGPCount",  14);
+        msg.Set("SatsTrackedGPCount", 9);
+        msg.Set("Cn0MeanGPDbHz",      36);
+        msg.Set("Cn0MaxGPDbHz",       48);
+
+        msg.SetId13("Q3");
+        msg.SetHdrSlot(2);
+        msg.Encode();
+
+        CheckUserDefined("sat stats", msg);
+    }
+
+    // every header slot, with the field at both ends of its range
+    for (uint8_t slot = 0; slot < 5; ++slot)
+    {
+        for (double value : { 0.0, 21340.0 })
+        {
+            MsgUD msg;
+            msg.ResetEverything();
+            msg.DefineField("AltitudeMeters", 0, 21340, 20);
+
+            msg.Set("AltitudeMeters", value);
+
+            msg.SetId13("03");
+            msg.SetHdrSlot(slot);
+            msg.Encode();
+
+            CheckUserDefined("slot " + to_string(slot) + " alt " + to_string((int)value), msg);
+        }
+    }
+}
+
+
+int main()
+{
+    TestBasic();
+    TestUserDefined();
+
+    printf("%s (%u failed)\n", failCount ? "FAIL" : "OK", failCount);
+
+    return failCount ? 1 : 0;
+}